@@ -0,0 +1,32 @@
+// include/classes/HIDAbsolutePointer.h
+#ifndef HID_ABSOLUTE_POINTER_H
+#define HID_ABSOLUTE_POINTER_H
+
+#include <USBHID.h>
+#include <cstdint>
+#include <config/Config.h>
+
+struct __attribute__((packed)) HIDPointerReport {
+  uint8_t buttons;
+  uint16_t x;           // 0 .. USB_POINTER_LOGICAL_MAX across the whole screen
+  uint16_t y;
+};
+
+extern const uint8_t pointerReportDescriptor[];
+extern const size_t pointerReportDescriptorSize;
+
+// Absolute pointer, the host puts the cursor at the reported position regardless of acceleration
+class HIDAbsolutePointer : public USBHIDDevice {
+private:
+  USBHID hid;
+
+public:
+  HIDAbsolutePointer();
+
+  void begin();
+  uint16_t _onGetDescriptor(uint8_t* buffer) override;
+
+  bool move(uint16_t x, uint16_t y, uint8_t buttons);
+};
+
+#endif // HID_ABSOLUTE_POINTER_H
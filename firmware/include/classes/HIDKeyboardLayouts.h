@@ -0,0 +1,46 @@
+// include/classes/HIDKeyboardLayouts.h
+#ifndef HID_KEYBOARD_LAYOUTS_H
+#define HID_KEYBOARD_LAYOUTS_H
+
+#include <cstdint>
+
+// Layout the SBC is set to, text is translated on the device so clients can send plain UTF-8
+enum HIDLayoutId : uint8_t {
+  HID_LAYOUT_US,
+  HID_LAYOUT_UK,
+  HID_LAYOUT_DE,
+  HID_LAYOUT_PL,    // Polish (programmer's), AltGr letters
+  HID_LAYOUT_COUNT
+};
+
+// How characters the layout can not produce are entered, each OS has its own Unicode input method
+enum HIDUnicodeMode : uint8_t {
+  HID_UNICODE_NONE,       // Skip them
+  HID_UNICODE_LINUX,      // Ctrl+Shift+U, hex, space (IBus / GTK)
+  HID_UNICODE_WINDOWS,    // Hold Alt, keypad +, hex (needs EnableHexNumpad), BMP only
+  HID_UNICODE_MACOS,      // Hold Option, hex (needs the Unicode Hex Input source), BMP only
+  HID_UNICODE_MODE_COUNT
+};
+
+#define HID_MODIFIER_LEFT_CTRL              0x01
+#define HID_MODIFIER_LEFT_SHIFT             0x02
+#define HID_MODIFIER_LEFT_ALT               0x04
+#define HID_MODIFIER_RIGHT_ALT              0x40    // AltGr
+#define HID_STROKE_DEAD                     0x80    // Not a modifier here (right GUI is never typed), the key is a dead key and needs a space after it
+
+#define HID_LAYOUT_CODE_POINTS              0x180   // Direct lookup covers Basic Latin through Latin Extended-A
+
+struct HIDKeyStroke {
+  uint8_t keycode;      // HID usage, 0 when the layout has no key for the character
+  uint8_t modifiers;
+};
+
+bool lookupKeyStroke(HIDLayoutId layout, uint32_t codePoint, HIDKeyStroke& stroke);
+bool lookupKeyCode(uint8_t key, HIDKeyStroke& stroke);
+
+const char* getLayoutName(HIDLayoutId layout);
+bool parseLayoutName(const char* name, HIDLayoutId& layout);
+const char* getUnicodeModeName(HIDUnicodeMode mode);
+bool parseUnicodeModeName(const char* name, HIDUnicodeMode& mode);
+
+#endif // HID_KEYBOARD_LAYOUTS_H
@@ -0,0 +1,42 @@
+// include/classes/HIDNKROKeyboard.h
+#ifndef HID_NKRO_KEYBOARD_H
+#define HID_NKRO_KEYBOARD_H
+
+#include <USBHID.h>
+#include <USBHIDKeyboard.h>
+#include <cstdint>
+#include <config/Config.h>
+
+#define HID_NKRO_KEY_BYTES  (USB_NKRO_MAX_USAGE / 8 + 1)
+
+struct __attribute__((packed)) HIDNKROReport {
+  uint8_t modifiers;
+  uint8_t keys[HID_NKRO_KEY_BYTES];   // Bit n is keyboard usage n
+};
+
+extern const uint8_t nkroReportDescriptor[];
+extern const size_t nkroReportDescriptorSize;
+
+// Bitmap keyboard next to the 6KRO USBHIDKeyboard, every key can be down at once and a whole
+// state change is one report. Takes the same key codes as USBHIDKeyboard.
+class HIDNKROKeyboard : public USBHIDDevice {
+private:
+  USBHID hid;
+  HIDNKROReport report;
+
+  bool setKey(uint8_t key, bool pressed);
+
+public:
+  HIDNKROKeyboard();
+
+  void begin();
+  uint16_t _onGetDescriptor(uint8_t* buffer) override;
+
+  bool press(uint8_t key);
+  bool release(uint8_t key);
+  void releaseAll();
+  bool sendReport(const KeyReport& keyReport);
+  bool sendReport();
+};
+
+#endif // HID_NKRO_KEYBOARD_H
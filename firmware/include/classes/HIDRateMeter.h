@@ -0,0 +1,45 @@
+// include/classes/HIDRateMeter.h
+#ifndef HID_RATE_METER_H
+#define HID_RATE_METER_H
+
+#include <cstdint>
+
+enum HIDReportDevice : uint8_t {
+  HID_REPORT_KEYBOARD,
+  HID_REPORT_MOUSE,
+  HID_REPORT_GAMEPAD,
+  HID_REPORT_POINTER,
+  HID_REPORT_DEVICE_COUNT
+};
+
+struct HIDRateStats {
+  uint32_t reports;     // Reports handed to the endpoint
+  uint32_t failed;      // Sends that timed out or were refused
+  uint32_t missed;      // Frames a periodic stream (typing, motion) skipped because it ran late
+};
+
+// Report counters per device over a measuring window, off unless started
+class HIDRateMeter {
+private:
+  bool enabled;
+  uint32_t startTime;
+  HIDRateStats stats[HID_REPORT_DEVICE_COUNT];
+
+public:
+  HIDRateMeter();
+
+  void start(uint32_t now);
+  void stop() { enabled = false; }
+  bool isEnabled() const { return enabled; }
+
+  void recordReport(HIDReportDevice device, bool delivered);
+  void recordMissed(HIDReportDevice device, uint32_t frames);
+
+  const HIDRateStats& getStats(HIDReportDevice device) const { return stats[device]; }
+  uint32_t getElapsed(uint32_t now) const { return now - startTime; }
+
+  static const char* getDeviceName(HIDReportDevice device);
+  static bool parseDeviceName(const char* name, HIDReportDevice& device);
+};
+
+#endif // HID_RATE_METER_H
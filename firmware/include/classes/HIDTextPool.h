@@ -0,0 +1,28 @@
+// include/classes/HIDTextPool.h
+#ifndef HID_TEXT_POOL_H
+#define HID_TEXT_POOL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <config/Config.h>
+
+// Byte ring holding the text of queued HID_KEYBOARD_TYPE messages, so the messages themselves stay small.
+// Text is allocated in queue order and released in the same order once typed, which is all a ring needs.
+// Not thread safe, USBManager guards it with its queue mutex.
+class HIDTextPool {
+private:
+  char buffer[USB_HID_TEXT_POOL_SIZE];
+  uint16_t head;
+  uint16_t used;        // The oldest text starts used bytes behind head
+
+public:
+  HIDTextPool() : head(0), used(0) {}
+
+  bool allocate(const char* text, uint16_t length, uint16_t& offset);
+  void release(uint16_t length);
+  void copy(uint16_t offset, uint16_t start, char* out, size_t count) const;
+
+  uint16_t available() const { return USB_HID_TEXT_POOL_SIZE - used; }
+};
+
+#endif // HID_TEXT_POOL_H
@@ -0,0 +1,59 @@
+// include/classes/HIDTimerWheel.h
+#ifndef HID_TIMER_WHEEL_H
+#define HID_TIMER_WHEEL_H
+
+#include <cstdint>
+#include <config/Config.h>
+
+enum HIDTimerAction : uint8_t {
+  HID_TIMER_KEY_RELEASE,
+  HID_TIMER_MOUSE_RELEASE,
+  HID_TIMER_GAMEPAD_RELEASE,
+  HID_TIMER_CONSUMER_RELEASE
+};
+
+struct HIDTimer {
+  HIDTimerAction action;
+  uint8_t code;       // Key, mouse button mask or gamepad button
+};
+
+// Hashed timer wheel for pending HID releases. Scheduling and cancelling are O(1) and O(capacity),
+// expiry costs one slot per tick. Delays past one revolution wait out extra rounds.
+class HIDTimerWheel {
+private:
+  static constexpr uint8_t NONE = 0xFF;
+
+  struct Entry {
+    HIDTimer timer;
+    uint8_t rounds;
+    uint8_t next;
+    bool active;
+  };
+
+  Entry entries[USB_TIMER_WHEEL_CAPACITY];
+  uint8_t slots[USB_TIMER_WHEEL_SLOTS];
+  uint8_t freeList;
+  uint8_t expiredList;
+  uint8_t count;
+
+  uint32_t currentTick;
+  uint32_t lastTickTime;
+  bool started;
+
+  void unlink(uint8_t* head, uint8_t index);
+  void remove(uint8_t index);
+  void advance(uint32_t now);
+
+public:
+  HIDTimerWheel();
+
+  bool schedule(const HIDTimer& timer, uint32_t delayMs, uint32_t now);
+  bool cancel(HIDTimerAction action, uint8_t code);
+  uint8_t cancelAll(HIDTimerAction action);
+  bool popExpired(uint32_t now, HIDTimer& timer);
+
+  bool isEmpty() const { return count == 0; }
+  uint8_t getFreeCount() const { return USB_TIMER_WHEEL_CAPACITY - count; }
+};
+
+#endif // HID_TIMER_WHEEL_H
@@ -0,0 +1,75 @@
+// include/classes/HIDTypingEngine.h
+#ifndef HID_TYPING_ENGINE_H
+#define HID_TYPING_ENGINE_H
+
+#include <cstdint>
+#include <USBHIDKeyboard.h>
+#include <config/Config.h>
+#include <classes/HIDTextPool.h>
+#include <classes/HIDKeyboardLayouts.h>
+
+// Turns queued UTF-8 text into 6KRO keyboard reports for the selected layout. Consecutive characters share a
+// report as long as their keys are distinct and need the same modifiers, so up to six characters go out per
+// report. A release frame is only inserted where a key has to be pressed again or the modifiers change.
+// Dead keys and characters missing from the layout are typed as a short sequence of frames instead.
+// A UTF-8 character cut off at the end of a message is held back and completed by the next message, as long as
+// that message starts within USB_TYPING_CARRY_TIMEOUT_MS.
+class HIDTypingEngine {
+private:
+  static constexpr uint8_t MAX_SEQUENCE = 16;
+  static constexpr uint32_t PARTIAL_CODE_POINT = 0xFFFFFFFF;
+
+  const HIDTextPool* pool;
+  uint16_t offset;
+  uint16_t length;
+  uint16_t position;
+  bool active;
+
+  uint8_t carry[3];           // Leading bytes of a character split across messages
+  uint8_t carryLength;
+  uint32_t carryTime;
+
+  HIDLayoutId layout;
+  HIDUnicodeMode unicodeMode;
+
+  KeyReport sequence[MAX_SEQUENCE];
+  uint8_t sequenceLength;
+  uint8_t sequenceIndex;
+
+  KeyReport lastReport;
+  uint8_t lastKeyCount;
+  uint16_t charsPerSecond;
+  uint8_t minFrameMs;
+  uint32_t nextFrameTime;
+  uint32_t frameRemainderUs;  // Pacing carry below 1 ms
+
+  uint32_t peekCodePoint(uint8_t& size) const;
+  void consume(uint8_t size);
+  bool isPressed(uint8_t keycode) const;
+  bool buildSequence(uint32_t codePoint, bool mapped, const HIDKeyStroke& stroke);
+  void appendFrame(uint8_t modifiers, uint8_t keycode);
+  void appendHexDigits(uint32_t value, uint8_t minDigits, uint8_t heldModifiers, bool keypad);
+  void scheduleNextFrame(uint32_t now, uint8_t characters);
+
+public:
+  HIDTypingEngine();
+
+  void start(const HIDTextPool* textPool, uint16_t textOffset, uint16_t textLength, uint32_t now);
+  bool nextFrame(uint32_t now, KeyReport& report);
+
+  bool isActive() const { return active; }
+  uint16_t getLength() const { return length; }
+  uint32_t getTimeUntilNextFrame(uint32_t now) const;
+  uint32_t getFrameLateness(uint32_t now) const;
+
+  bool setRate(uint16_t cps);
+  uint16_t getRate() const { return charsPerSecond; }
+  void setMinFrameInterval(uint8_t intervalMs) { minFrameMs = intervalMs > 0 ? intervalMs : 1; }
+
+  bool setLayout(HIDLayoutId layoutId, HIDUnicodeMode mode);
+  void clearCarry() { carryLength = 0; }
+  HIDLayoutId getLayout() const { return layout; }
+  HIDUnicodeMode getUnicodeMode() const { return unicodeMode; }
+};
+
+#endif // HID_TYPING_ENGINE_H
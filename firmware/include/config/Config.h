@@ -96,6 +96,51 @@
 #define USB_HID_KEYBOARD_PRESS_DELAY        50      // Delay after pressing a key before releasing it (ms)
 #define USB_HID_MOUSE_PRESS_DELAY           50      // Delay after pressing a mouse button before releasing it (ms)
 #define USB_HID_GAMEPAD_PRESS_DELAY         50      // Delay after pressing a gamepad button before releasing it (ms)
+#define USB_HID_SYSTEM_POWER_PRESS_DELAY    200     // Delay after pressing the consumer power key before releasing it (ms)
+
+// USB HID Gamepad
+#define USB_GAMEPAD_BUTTON_COUNT            32      // Buttons 1 .. 32, button 1 is bit 0 of the report
+#define USB_GAMEPAD_AXIS_MAX                127     // Sticks and triggers run -127 .. 127
+
+// USB HID Release Timer Wheel (press delays above are scheduled here instead of blocking the USB task)
+#define USB_TIMER_WHEEL_TICK_MS             5       // Release timing resolution (ms)
+#define USB_TIMER_WHEEL_SLOTS               64      // One revolution covers 320 ms, longer delays take extra rounds
+#define USB_TIMER_WHEEL_CAPACITY            32      // Most releases pending at once
+
+// USB HID Jitter Buffer
+#define USB_JITTER_DEFAULT_DELAY_MS         20      // Target delay between the client producing an event and it reaching USB (ms)
+#define USB_JITTER_MAX_DELAY_MS             200     // Largest target delay a client may request (ms)
+
+// USB HID Typing Engine
+#define USB_TYPING_DEFAULT_CPS              1000    // Target typing speed (characters per second)
+#define USB_TYPING_MIN_CPS                  10
+#define USB_TYPING_MAX_CPS                  6000    // Six keys per report, one report per 1 ms USB frame
+#define USB_TYPING_CARRY_TIMEOUT_MS         1000    // Drop a split UTF-8 character if the rest does not follow within this (ms)
+#define USB_PREFS_NAMESPACE                 "usb"   // NVS namespace for the typing layout settings
+#define USB_PREFS_LAYOUT_KEY                "kb_layout"
+#define USB_PREFS_UNICODE_KEY               "kb_unicode"
+#define USB_PREFS_NKRO_KEY                  "kb_nkro"
+
+// USB HID Report Intervals (the Arduino core polls its one HID endpoint every 1 ms, these pace what the firmware generates)
+#define USB_REPORT_INTERVAL_KEYBOARD_MS     1       // Shortest spacing of typing frames (ms)
+#define USB_REPORT_INTERVAL_MOUSE_MS        4       // Mouse velocity frames (ms)
+#define USB_REPORT_INTERVAL_GAMEPAD_MS      4       // Stick ramp frames (ms)
+#define USB_REPORT_MAX_INTERVAL_MS          100     // Longest interval a client may set (ms)
+
+// USB HID Motion Engine
+#define USB_MOTION_DEFAULT_TIMEOUT_MS       500     // Mouse velocity stops on its own unless the client renews it (ms)
+#define USB_MOTION_MAX_DURATION_MS          10000   // Longest velocity timeout or axis ramp a client may request (ms)
+
+// USB HID NKRO Keyboard (bitmap keyboard next to the 6KRO one). The Arduino core declares its composite HID interface
+// without boot protocol, so neither keyboard works in a BIOS; the 6KRO report only stays for hosts that can't parse the bitmap.
+#define USB_NKRO_ENABLED                    true    // Default until HID_KEYBOARD_NKRO stores a choice
+#define USB_NKRO_REPORT_ID                  7
+#define USB_NKRO_MAX_USAGE                  0xA7    // Highest keyboard usage in the bitmap, one less than a multiple of 8
+
+// USB HID Absolute Pointer
+#define USB_POINTER_REPORT_ID               8
+#define USB_POINTER_LOGICAL_MAX             32767   // Whole screen width and height in pointer units
+#define USB_POINTER_MAX_SURFACE             32768   // Largest client surface, also the default so coordinates pass through 1:1
 
 // ====================================================================
 // USB VENDOR HID CONFIGURATION
@@ -112,12 +157,70 @@
 #define BLE_SERVICE_UUID                    "6E400001-B5A3-F393-E0A9-E50E24DCCA9E"
 #define BLE_CHARACTERISTIC_TX_UUID          "6E400003-B5A3-F393-E0A9-E50E24DCCA9E" // TX (device to client)
 #define BLE_CHARACTERISTIC_RX_UUID          "6E400002-B5A3-F393-E0A9-E50E24DCCA9E" // RX (client to device)
+#define BLE_CHARACTERISTIC_TELEMETRY_UUID   "6E400004-B5A3-F393-E0A9-E50E24DCCA9E" // Power telemetry stream (device to client)
+#define BLE_CHARACTERISTIC_POWER_STATUS_UUID "6E400005-B5A3-F393-E0A9-E50E24DCCA9E" // Cached binary power status, all telemetry fields (read/notify)
+#define BLE_CHARACTERISTIC_INPUT_UUID       "6E400006-B5A3-F393-E0A9-E50E24DCCA9E" // Binary HID input stream (write without response), notifies cumulative acks
+#define BLE_BATTERY_SERVICE_UUID            "180F"  // Standard GATT Battery Service
+#define BLE_BATTERY_LEVEL_UUID              "2A19"  // Battery Level, uint8 0-100 (read/notify)
+
+// BLE Advertising Schedule (intervals in 0.625 ms units)
+#define BLE_ADV_FAST_INTERVAL               32      // 20 ms right after boot, wake or disconnect
+#define BLE_ADV_SLOW_INTERVAL               1636    // 1022.5 ms once nobody has connected for a while
+#define BLE_ADV_POWER_SAVING_FAST_INTERVAL  160     // 100 ms burst start while in power saving mode
+#define BLE_ADV_POWER_SAVING_SLOW_INTERVAL  3200    // 2 s
+#define BLE_ADV_BACKOFF_STEP_MS             10000   // Interval doubles after each step without a connection
+
+// BLE Bonding and Wake Reconnect
+#define BLE_PREFS_NAMESPACE                 "ble"   // NVS namespace for the last bonded central, NimBLE keeps the keys itself
+#define BLE_PREFS_LAST_PEER_KEY             "last_peer"
+#define BLE_PREFS_LAST_PEER_TYPE_KEY        "last_peer_t"
+#define BLE_RECONNECT_DIRECTED_MS           1500    // Directed advertising toward the last central right after wake
+#define BLE_RECONNECT_WHITELIST_MS          3000    // Then undirected, but only bonded centrals on the whitelist may connect
+
+// BLE Advertised Telemetry (manufacturer data: COMPANY_ID u16 LE | VERSION u8 | BATTERY_PERCENTAGE u8 | STATE u8)
+#define BLE_ADV_COMPANY_ID                  0xFFFF  // Reserved SIG value for devices without an assigned company ID
+#define BLE_ADV_TELEMETRY_VERSION           0x01    // Bump when the manufacturer data layout changes
+
+#define BLE_MAX_CONNECTIONS                 3       // Concurrent centrals, e.g. a phone for telemetry and a controller for input
+#define BLE_PREFERRED_PHY_MASK              BLE_GAP_LE_PHY_2M_MASK // Ask for LE 2M on connect, the link stays on 1M if the peer can not do it
+#define BLE_PREFERRED_DATA_LEN              251     // Largest LL payload with DLE, default without it is 27
 
 // BLE Command Separators
 #define BLE_CMD_PART_SEPARATOR              ":"
 #define BLE_CMD_DATA_SEPARATOR              "|"
 #define BLE_CMD_WAS_SUCCESSFUL              "1"
 #define BLE_CMD_WAS_FAILURE                 "0"
+#define BLE_CMD_WAS_BUSY                    "2"     // HID queue is full, retry once the USB side drains
+#define BLE_CMD_BATCH_SEPARATOR             '\n'    // One write may carry several HID commands, one per line
+#define BLE_CMD_MAX_LENGTH                  256     // Longest single write on the RX characteristic, batch included
+#define BLE_CMD_MAX_PARTS                   9       // Command name plus up to 8 data fields (HID_GAMEPAD_STATE)
+#define BLE_CMD_MAX_BATCH                   8       // Most commands in one batch, must fit QUEUE_SIZE_HID
+#define BLE_CMD_JOB_ACCEPTED                "ACK"   // ACK:REQUEST_ID, long-running command was queued for the executor
+#define BLE_CMD_JOB_DONE                    "DONE"  // DONE:REQUEST_ID|WAS_SUCCESSFUL, sent once the executor finishes the command
+
+// BLE Input Stream
+#define BLE_INPUT_ACK_INTERVAL_MS           100     // Cumulative ack cadence while input keeps arriving, no per-event replies
+#define BLE_INPUT_CREDIT_BATCH              4       // Send an ack right away once this many new credits are granted
+
+// BLE Connection Parameters (intervals in 1.25 ms units, supervision timeout in 10 ms units)
+#define BLE_CONN_FAST_MIN_INTERVAL          6       // 7.5 ms while HID commands are flowing
+#define BLE_CONN_FAST_MAX_INTERVAL          12      // 15 ms
+#define BLE_CONN_FAST_LATENCY               0       // Answer every connection event
+#define BLE_CONN_FAST_TIMEOUT               400     // 4 s
+#define BLE_CONN_IDLE_MIN_INTERVAL          80      // 100 ms while the client only polls or listens to telemetry
+#define BLE_CONN_IDLE_MAX_INTERVAL          160     // 200 ms
+#define BLE_CONN_IDLE_LATENCY               4       // Peripheral may skip up to 4 connection events
+#define BLE_CONN_IDLE_TIMEOUT               600     // 6 s
+#define BLE_CONN_IDLE_AFTER_MS              3000    // Relax the connection after this long without HID commands
+#define BLE_CONN_PROFILE_RETRY_MS           1000    // Wait this long before asking again after a refused request
+
+// BLE Power Telemetry Subscription
+#define BLE_TELEMETRY_DEFAULT_PERIOD_MS     5000    // Minimum time between telemetry updates if the client does not pick one
+#define BLE_TELEMETRY_MIN_PERIOD_MS         TASK_INTERVAL_POWER // Telemetry can not be fresher than the power sampling rate
+#define BLE_TELEMETRY_KEEPALIVE_MS          30000   // Send an update even without changes so the client knows the stream is alive
+#define BLE_TELEMETRY_TIME_THRESHOLD_S      60      // Time to charge/discharge must move by this much to count as a change...
+#define BLE_TELEMETRY_TIME_THRESHOLD_PCT    10      // ...or by this share of the last sent value, whichever is larger
+#define BLE_TELEMETRY_MAX_PACKET_SIZE       20      // Fits in a single notification at the default MTU
 
 // ====================================================================
 // FREERTOS TASK CONFIGURATION
@@ -149,6 +252,9 @@
 // QUEUE CONFIGURATION
 // ====================================================================
 #define QUEUE_SIZE_COMMANDS                 10      // BLE command queue size
+#define QUEUE_SIZE_JOBS                     4       // BLE long-running command (executor) queue size
+#define QUEUE_SIZE_HID                      64      // USB HID event queue size, BLE input credits are granted from its free slots
+#define USB_HID_TEXT_POOL_SIZE              1024    // Bytes shared by the text of all queued HID_KEYBOARD_TYPE messages
 
 // ====================================================================
 // DEEP SLEEP CONFIGURATION
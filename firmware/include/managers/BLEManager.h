@@ -3,16 +3,15 @@
 #define BLE_MANAGER_H
 
 #include <cstdint>
-#include <BLEDevice.h>
-#include <BLEServer.h>
-#include <BLEUtils.h>
-#include <BLE2902.h>
+#include <NimBLEDevice.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/queue.h>
 #include <freertos/semphr.h>
 #include "../config/Config.h"
 #include <utils/DebugSerial.h>
+#include "managers/PowerManager.h"
+#include "managers/USBManager.h"
 
 // Forward declarations
 class StatusManager;
@@ -20,33 +19,52 @@ class StatusManager;
 // CMD:DATA|DATA... format
 enum BLECommand {
   BLE_CMD_POWER_INFO,                   // POWER_INFO -> POWER_INFO:BATTERY_VOLTAGE|BATTERY_CURRENT|TIME_TO_DISCHARGE|CHARGER_VOLTAGE|CHARGER_CURRENT|TIME_TO_CHARGE|BATTERY_PERCENTAGE
-  BLE_CMD_POWER_ON,                 // POWER_ON -> WAS_SUCCESSFUL
-  BLE_CMD_POWER_OFF,                // POWER_OFF -> WAS_SUCCESSFUL
-  BLE_CMD_SHUTDOWN,                 // SHUTDOWN -> WAS_SUCCESSFUL
+  BLE_CMD_POWER_ON,                 // POWER_ON -> ACK:REQUEST_ID, then DONE:REQUEST_ID|WAS_SUCCESSFUL
+  BLE_CMD_POWER_OFF,                // POWER_OFF -> ACK:REQUEST_ID, then DONE:REQUEST_ID|WAS_SUCCESSFUL
+  BLE_CMD_SHUTDOWN,                 // SHUTDOWN -> ACK:REQUEST_ID, then DONE:REQUEST_ID|WAS_SUCCESSFUL
+  BLE_CMD_POWER_SUBSCRIBE,          // POWER_SUBSCRIBE:FIELDS|PERIOD_MS|VOLTAGE_MV|CURRENT_MA|PERCENTAGE -> WAS_SUCCESSFUL
+  BLE_CMD_POWER_UNSUBSCRIBE,        // POWER_UNSUBSCRIBE -> WAS_SUCCESSFUL
 
   BLE_CMD_HID_KEYBOARD_PRESS,       // HID_KEYBOARD_PRESS:KEY -> WAS_SUCCESSFUL
   BLE_CMD_HID_KEYBOARD_HOLD,        // HID_KEYBOARD_HOLD:KEY -> WAS_SUCCESSFUL
   BLE_CMD_HID_KEYBOARD_RELEASE,     // HID_KEYBOARD_RELEASE:KEY -> WAS_SUCCESSFUL
   BLE_CMD_HID_KEYBOARD_TYPE,        // HID_KEYBOARD_TYPE:TEXT -> WAS_SUCCESSFUL
+  BLE_CMD_HID_TYPING_RATE,          // HID_TYPING_RATE:CHARS_PER_SECOND -> WAS_SUCCESSFUL
+  BLE_CMD_HID_TYPING_INFO,          // HID_TYPING_INFO -> HID_TYPING_INFO:CHARS_PER_SECOND|QUEUED_BYTES|FREE_BYTES|LAYOUT|UNICODE_MODE
+  BLE_CMD_HID_KEYBOARD_LAYOUT,      // HID_KEYBOARD_LAYOUT:LAYOUT|UNICODE_MODE -> WAS_SUCCESSFUL
+  BLE_CMD_HID_KEYBOARD_NKRO,        // HID_KEYBOARD_NKRO:ENABLE -> WAS_SUCCESSFUL
 
   BLE_CMD_HID_MOUSE_MOVE,           // HID_MOUSE_MOVE:X:Y -> WAS_SUCCESSFUL
   BLE_CMD_HID_MOUSE_PRESS,          // HID_MOUSE_PRESS:BUTTON -> WAS_SUCCESSFUL
   BLE_CMD_HID_MOUSE_HOLD,           // HID_MOUSE_HOLD:BUTTON -> WAS_SUCCESSFUL
   BLE_CMD_HID_MOUSE_RELEASE,        // HID_MOUSE_RELEASE:BUTTON -> WAS_SUCCESSFUL
   BLE_CMD_HID_MOUSE_SCROLL,         // HID_MOUSE_SCROLL:X:Y -> WAS_SUCCESSFUL
+  BLE_CMD_HID_MOUSE_VELOCITY,       // HID_MOUSE_VELOCITY:VX|VY|TIMEOUT_MS -> WAS_SUCCESSFUL
 
   BLE_CMD_HID_GAMEPAD_PRESS,        // HID_GAMEPAD_PRESS:BUTTON -> WAS_SUCCESSFUL
   BLE_CMD_HID_GAMEPAD_HOLD,         // HID_GAMEPAD_HOLD:BUTTON -> WAS_SUCCESSFUL
   BLE_CMD_HID_GAMEPAD_RELEASE,      // HID_GAMEPAD_RELEASE:BUTTON -> WAS_SUCCESSFUL
   BLE_CMD_HID_GAMEPAD_RIGHT_AXIS,   // HID_GAMEPAD_RIGHT_AXIS:X:Y -> WAS_SUCCESSFUL
   BLE_CMD_HID_GAMEPAD_LEFT_AXIS,    // HID_GAMEPAD_LEFT_AXIS:X:Y -> WAS_SUCCESSFUL
+  BLE_CMD_HID_GAMEPAD_AXIS_TARGET,  // HID_GAMEPAD_AXIS_TARGET:STICK|X|Y|RAMP_MS -> WAS_SUCCESSFUL
+  BLE_CMD_HID_GAMEPAD_STATE,        // HID_GAMEPAD_STATE:LX|LY|RX|RY|LT|RT|HAT|BUTTONS -> WAS_SUCCESSFUL
+
+  BLE_CMD_HID_POINTER_SURFACE,      // HID_POINTER_SURFACE:WIDTH|HEIGHT -> WAS_SUCCESSFUL
+  BLE_CMD_HID_POINTER_MOVE,         // HID_POINTER_MOVE:X|Y|BUTTONS -> WAS_SUCCESSFUL
 
   BLE_CMD_HID_SYSTEM_POWER,         // HID_SYSTEM_POWER -> WAS_SUCCESSFUL
+  BLE_CMD_HID_JITTER,               // HID_JITTER:ENABLE|DELAY_MS -> WAS_SUCCESSFUL
+  BLE_CMD_HID_JITTER_INFO,          // HID_JITTER_INFO -> HID_JITTER_INFO:ENABLED|DELAY_MS|EVENTS|LATE|AVG_LATENCY_MS|MAX_LATENCY_MS|AVG_JITTER_MS|MAX_JITTER_MS
+  BLE_CMD_CLOCK_SYNC,               // CLOCK_SYNC:CLIENT_MS -> CLOCK_SYNC:DEVICE_MS
+  BLE_CMD_HID_REPORT_INTERVAL,      // HID_REPORT_INTERVAL:DEVICE|MS -> WAS_SUCCESSFUL
+  BLE_CMD_HID_RATE,                 // HID_RATE:ENABLE -> WAS_SUCCESSFUL
+  BLE_CMD_HID_RATE_INFO,            // HID_RATE_INFO -> HID_RATE_INFO:ENABLED|ELAPSED_MS then DEVICE|INTERVAL_MS|REPORTS|RATE|FAILED|MISSED per device
   BLE_CMD_SYSTEM_INFO,              // SYSTEM_INFO -> SYSTEM_INFO:WIFI_MAC|BLUETOOTH_MAC|FIRMWARE_VERSION|UPTIME
-  BLE_CMD_SYSTEM_RESTART,           // SYSTEM_RESTART -> WAS_SUCCESSFUL
+  BLE_CMD_SYSTEM_RESTART,           // SYSTEM_RESTART -> ACK:REQUEST_ID, then DONE:REQUEST_ID|WAS_SUCCESSFUL
   BLE_CMD_DEEP_SLEEP_INFO,          // DEEP_SLEEP_INFO -> DEEP_SLEEP_INFO:ENABLED|TIME_UNTIL_SLEEP_MS
   BLE_CMD_DEEP_SLEEP_ENABLE,        // DEEP_SLEEP_ENABLE -> WAS_SUCCESSFUL
   BLE_CMD_DEEP_SLEEP_DISABLE,       // DEEP_SLEEP_DISABLE -> WAS_SUCCESSFUL
+  BLE_CMD_BLE_INFO,                 // BLE_INFO -> BLE_INFO:MTU|INTERVAL_MS|LATENCY|TIMEOUT_MS|PROFILE|RENEGOTIATIONS|INIT_MS|INIT_HEAP|CONNECT_MS|CLIENTS|TX_PHY|RX_PHY|DATA_LEN|ADV_INTERVAL_MS|WAKE_CONNECT_MS|RECONNECT_PATH
   BLE_CMD_HELP,                     // HELP -> COMMAND_LIST
   BLE_CMD_SYNTAX_ERROR,             // Syntax error in command
   BLE_CMD_UNKNOWN                   // Unknown command
@@ -60,26 +78,44 @@ static const struct {
   {"POWER_ON", BLE_CMD_POWER_ON},
   {"POWER_OFF", BLE_CMD_POWER_OFF},
   {"SHUTDOWN", BLE_CMD_SHUTDOWN},
+  {"POWER_SUBSCRIBE", BLE_CMD_POWER_SUBSCRIBE},
+  {"POWER_UNSUBSCRIBE", BLE_CMD_POWER_UNSUBSCRIBE},
   {"HID_KEYBOARD_PRESS", BLE_CMD_HID_KEYBOARD_PRESS},
   {"HID_KEYBOARD_HOLD", BLE_CMD_HID_KEYBOARD_HOLD},
   {"HID_KEYBOARD_RELEASE", BLE_CMD_HID_KEYBOARD_RELEASE},
   {"HID_KEYBOARD_TYPE", BLE_CMD_HID_KEYBOARD_TYPE},
+  {"HID_TYPING_RATE", BLE_CMD_HID_TYPING_RATE},
+  {"HID_TYPING_INFO", BLE_CMD_HID_TYPING_INFO},
+  {"HID_KEYBOARD_LAYOUT", BLE_CMD_HID_KEYBOARD_LAYOUT},
+  {"HID_KEYBOARD_NKRO", BLE_CMD_HID_KEYBOARD_NKRO},
   {"HID_MOUSE_MOVE", BLE_CMD_HID_MOUSE_MOVE},
   {"HID_MOUSE_PRESS", BLE_CMD_HID_MOUSE_PRESS},
   {"HID_MOUSE_HOLD", BLE_CMD_HID_MOUSE_HOLD},
   {"HID_MOUSE_RELEASE", BLE_CMD_HID_MOUSE_RELEASE},
   {"HID_MOUSE_SCROLL", BLE_CMD_HID_MOUSE_SCROLL},
+  {"HID_MOUSE_VELOCITY", BLE_CMD_HID_MOUSE_VELOCITY},
   {"HID_GAMEPAD_PRESS", BLE_CMD_HID_GAMEPAD_PRESS},
   {"HID_GAMEPAD_HOLD", BLE_CMD_HID_GAMEPAD_HOLD},
   {"HID_GAMEPAD_RELEASE", BLE_CMD_HID_GAMEPAD_RELEASE},
   {"HID_GAMEPAD_RIGHT_AXIS", BLE_CMD_HID_GAMEPAD_RIGHT_AXIS},
   {"HID_GAMEPAD_LEFT_AXIS", BLE_CMD_HID_GAMEPAD_LEFT_AXIS},
+  {"HID_GAMEPAD_AXIS_TARGET", BLE_CMD_HID_GAMEPAD_AXIS_TARGET},
+  {"HID_GAMEPAD_STATE", BLE_CMD_HID_GAMEPAD_STATE},
+  {"HID_POINTER_SURFACE", BLE_CMD_HID_POINTER_SURFACE},
+  {"HID_POINTER_MOVE", BLE_CMD_HID_POINTER_MOVE},
   {"HID_SYSTEM_POWER", BLE_CMD_HID_SYSTEM_POWER},
+  {"HID_JITTER", BLE_CMD_HID_JITTER},
+  {"HID_JITTER_INFO", BLE_CMD_HID_JITTER_INFO},
+  {"CLOCK_SYNC", BLE_CMD_CLOCK_SYNC},
+  {"HID_REPORT_INTERVAL", BLE_CMD_HID_REPORT_INTERVAL},
+  {"HID_RATE", BLE_CMD_HID_RATE},
+  {"HID_RATE_INFO", BLE_CMD_HID_RATE_INFO},
   {"SYSTEM_INFO", BLE_CMD_SYSTEM_INFO},
   {"SYSTEM_RESTART", BLE_CMD_SYSTEM_RESTART},
   {"DEEP_SLEEP_INFO", BLE_CMD_DEEP_SLEEP_INFO},
   {"DEEP_SLEEP_ENABLE", BLE_CMD_DEEP_SLEEP_ENABLE},
   {"DEEP_SLEEP_DISABLE", BLE_CMD_DEEP_SLEEP_DISABLE},
+  {"BLE_INFO", BLE_CMD_BLE_INFO},
   {"HELP", BLE_CMD_HELP}
 };
 
@@ -89,17 +125,24 @@ static const char* BLE_HELP_STRING =
 "POWER_ON - Turn on SBC power\n"
 "POWER_OFF - Turn off SBC power\n"
 "SHUTDOWN - Shutdown system\n"
+"POWER_SUBSCRIBE:FIELDS|PERIOD_MS|VOLTAGE_MV|CURRENT_MA|PERCENTAGE - Stream binary power telemetry on the telemetry characteristic (FIELDS bitmask, thresholds are minimum changes)\n"
+"POWER_UNSUBSCRIBE - Stop power telemetry stream\n"
 "SYSTEM_INFO - Get system information (SYSTEM_INFO:WIFI_MAC|BLUETOOTH_MAC|FIRMWARE_VERSION|UPTIME)\n"
 "SYSTEM_RESTART - Restart system\n"
 "DEEP_SLEEP_INFO - Get deep sleep info\n"
 "DEEP_SLEEP_ENABLE - Enable deep sleep watchdog\n"
 "DEEP_SLEEP_DISABLE - Disable deep sleep watchdog\n"
+"BLE_INFO - Get BLE link info for this connection (BLE_INFO:MTU|INTERVAL_MS|LATENCY|TIMEOUT_MS|PROFILE|RENEGOTIATIONS|INIT_MS|INIT_HEAP|CONNECT_MS|CLIENTS|TX_PHY|RX_PHY|DATA_LEN|ADV_INTERVAL_MS|WAKE_CONNECT_MS|RECONNECT_PATH)\n"
 "\n"
 "=== HID Keyboard Commands ===\n"
 "HID_KEYBOARD_PRESS:KEY - Press and release key (ASCII code)\n"
 "HID_KEYBOARD_HOLD:KEY - Hold key down (ASCII code)\n"
 "HID_KEYBOARD_RELEASE:KEY - Release held key (ASCII code)\n"
-"HID_KEYBOARD_TYPE:TEXT - Type text string\n"
+"HID_KEYBOARD_TYPE:TEXT - Type text string, everything after the ':' (| included); send long text as several commands, 2 means retry once typed. A UTF-8 character split between commands is typed once the next one completes it\n"
+"HID_TYPING_RATE:CPS - Set typing speed in characters per second\n"
+"HID_TYPING_INFO - Get typing state (HID_TYPING_INFO:CHARS_PER_SECOND|QUEUED_BYTES|FREE_BYTES|LAYOUT|UNICODE_MODE)\n"
+"HID_KEYBOARD_LAYOUT:LAYOUT|UNICODE_MODE - Set the host layout for typed text (US, UK, DE, PL) and how other characters are entered (NONE, LINUX, WINDOWS, MACOS)\n"
+"HID_KEYBOARD_NKRO:ENABLE - Send keys on the NKRO keyboard (1) or the 6KRO one (0) for hosts that can't parse the bitmap; neither is a boot keyboard\n"
 "\n"
 "=== HID Mouse Commands ===\n"
 "HID_MOUSE_MOVE:X|Y - Move mouse by X,Y pixels\n"
@@ -107,21 +150,44 @@ static const char* BLE_HELP_STRING =
 "HID_MOUSE_HOLD:BTN - Hold mouse button down\n"
 "HID_MOUSE_RELEASE:BTN - Release held mouse button\n"
 "HID_MOUSE_SCROLL:X|Y - Scroll mouse wheel X,Y units\n"
+"HID_MOUSE_VELOCITY:VX|VY|TIMEOUT_MS - Keep moving at VX,VY px/s until TIMEOUT_MS passes or the next velocity (0|0 stops)\n"
 "\n"
 "=== HID Gamepad Commands ===\n"
-"HID_GAMEPAD_PRESS:BTN - Press and release gamepad button\n"
+"HID_GAMEPAD_PRESS:BTN - Press and release gamepad button (1..32)\n"
 "HID_GAMEPAD_HOLD:BTN - Hold gamepad button down\n"
 "HID_GAMEPAD_RELEASE:BTN - Release held gamepad button\n"
 "HID_GAMEPAD_RIGHT_AXIS:X|Y - Set right stick X,Y values\n"
 "HID_GAMEPAD_LEFT_AXIS:X|Y - Set left stick X,Y values\n"
+"HID_GAMEPAD_AXIS_TARGET:STICK|X|Y|RAMP_MS - Sweep stick (0 left, 1 right) to X,Y over RAMP_MS\n"
+"HID_GAMEPAD_STATE:LX|LY|RX|RY|LT|RT|HAT|BUTTONS - Set the whole gamepad in one report (axes -127..127, HAT 0 center, 1 up .. 8 up-left, BUTTONS bit 0 = button 1)\n"
+"\n"
+"=== HID Pointer Commands ===\n"
+"HID_POINTER_SURFACE:WIDTH|HEIGHT - Size of the client surface that maps onto the whole screen\n"
+"HID_POINTER_MOVE:X|Y|BUTTONS - Put the cursor at X,Y on the client surface, BUTTONS (1 left, 2 right, 4 middle) held\n"
 "\n"
 "=== HID System Commands ===\n"
 "HID_SYSTEM_POWER - Send system power key\n"
 "\n"
+"=== HID Timing Commands ===\n"
+"CLOCK_SYNC:CLIENT_MS - Sync this connection's clock for timestamped input records (CLOCK_SYNC:DEVICE_MS)\n"
+"HID_JITTER:ENABLE|DELAY_MS - Play HID events out at their timestamp + DELAY_MS instead of as they arrive\n"
+"HID_JITTER_INFO - Get jitter buffer stats (HID_JITTER_INFO:ENABLED|DELAY_MS|EVENTS|LATE|AVG_LATENCY_MS|MAX_LATENCY_MS|AVG_JITTER_MS|MAX_JITTER_MS)\n"
+"HID_REPORT_INTERVAL:DEVICE|MS - Set the report interval of KEYBOARD (typing), MOUSE (velocity) or GAMEPAD (stick ramps), 1 ms and up\n"
+"HID_RATE:ENABLE - Start (1, resets the counters) or stop (0) measuring report rates\n"
+"HID_RATE_INFO - Get report rates (HID_RATE_INFO:ENABLED|ELAPSED_MS then DEVICE|INTERVAL_MS|REPORTS|RATE|FAILED|MISSED per device)\n"
+"\n"
 "=== Help ===\n"
 "HELP - Show this command list\n"
 "\n"
-"Format: CMD:DATA|DATA... (use : for command data, | for separators)\n";
+"Format: CMD:DATA|DATA... (use : for command data, | for separators)\n"
+"Several HID commands in one write, one per line, run as one batch with a single reply (1, 0 or 2), all or nothing\n"
+"POWER_ON, POWER_OFF, SHUTDOWN and SYSTEM_RESTART reply ACK:REQUEST_ID at once and DONE:REQUEST_ID|RESULT when finished\n"
+"Responses and telemetry only go to the connection that sent the command\n"
+"Battery Service (0x180F) and the power status characteristic can be read directly, no command needed\n"
+"Input characteristic takes binary HID records without per-event replies, see BLEInputRecordType\n"
+"Input record types with 0x80 set carry a TIME u16 in the CLOCK_SYNC clock, played out by HID_JITTER\n"
+"Input acks grant credits, one per record; HID commands reply 2 when the HID queue is full\n"
+"Advertisements carry manufacturer data 0xFFFF: VERSION|BATTERY_PERCENTAGE|STATE for passive scanners\n";
 
 static const char* BLE_CMD_UNKNOWN_STRING =
 "Unknown command, type 'HELP' for a list of available commands.";
@@ -129,50 +195,243 @@ static const char* BLE_CMD_UNKNOWN_STRING =
 static const char* BLE_CONNECTED_STRING = "Device connected";
 
 struct BLEMessage {
+  uint16_t connHandle;              // Connection the command came from, responses go back only there
   BLECommand command;
-  char rawData[128];
-  char parsedData[8][32];
+  char rawData[BLE_CMD_MAX_LENGTH];
+  char parsedData[BLE_CMD_MAX_PARTS][32];
   uint8_t dataCount;
   uint32_t timestamp;
 };
 
+// Binary input stream packet: [SEQ u16] then records of [TYPE u8][PAYLOAD], all little-endian.
+// Payload length is fixed per type, an unknown type rejects the rest of the packet.
+// BLE_INPUT_FLAG_TIMESTAMP on the type puts [TIME u16] before the payload, the low 16 bits of the client's
+// CLOCK_SYNC clock in ms when the event was produced.
+enum BLEInputRecordType : uint8_t {
+  BLE_INPUT_KEYBOARD_PRESS = 0x01,      // KEY u8
+  BLE_INPUT_KEYBOARD_HOLD = 0x02,       // KEY u8
+  BLE_INPUT_KEYBOARD_RELEASE = 0x03,    // KEY u8
+  BLE_INPUT_KEYBOARD_REPORT = 0x04,     // MODIFIERS u8, RESERVED u8, KEYS u8[6]
+  BLE_INPUT_MOUSE_MOVE = 0x10,          // X i16, Y i16
+  BLE_INPUT_MOUSE_PRESS = 0x11,         // BUTTONS u8
+  BLE_INPUT_MOUSE_HOLD = 0x12,          // BUTTONS u8
+  BLE_INPUT_MOUSE_RELEASE = 0x13,       // BUTTONS u8
+  BLE_INPUT_MOUSE_SCROLL = 0x14,        // X i16, Y i16
+  BLE_INPUT_MOUSE_VELOCITY = 0x15,      // VX i16, VY i16 (px/s), TIMEOUT_MS u16
+  BLE_INPUT_MOUSE_REPORT = 0x16,        // BUTTONS u8, X i8, Y i8, WHEEL i8, PAN i8
+  BLE_INPUT_GAMEPAD_PRESS = 0x20,       // BUTTON u8
+  BLE_INPUT_GAMEPAD_HOLD = 0x21,        // BUTTON u8
+  BLE_INPUT_GAMEPAD_RELEASE = 0x22,     // BUTTON u8
+  BLE_INPUT_GAMEPAD_LEFT_AXIS = 0x23,   // X i16, Y i16
+  BLE_INPUT_GAMEPAD_RIGHT_AXIS = 0x24,  // X i16, Y i16
+  BLE_INPUT_GAMEPAD_AXIS_TARGET = 0x25, // X i16, Y i16, RAMP_MS u16, STICK u8
+  BLE_INPUT_GAMEPAD_REPORT = 0x26,      // LX, LY, RX, RY, LT, RT i8, HAT u8, BUTTONS u32
+  BLE_INPUT_SYSTEM_POWER = 0x30,        // No payload
+  BLE_INPUT_POINTER_MOVE = 0x40,        // X u16, Y u16 on the client surface, BUTTONS u8
+  BLE_INPUT_FLAG_TIMESTAMP = 0x80
+};
+
+// Cumulative input stream ack, notified on the input characteristic. Counters wrap, clients compare differences.
+// Each record costs one credit, the client may send records while its sent count is below creditLimit.
+struct __attribute__((packed)) BLEInputAck {
+  uint16_t lastSeq;     // Sequence number of the newest packet seen
+  uint16_t received;    // Packets received
+  uint16_t lost;        // Packets missing from the sequence
+  uint16_t dropped;     // Events the HID queue could not take
+  uint16_t rejected;    // Malformed records
+  uint16_t overrun;     // Records sent without credit, not executed (backpressure)
+  uint32_t creditLimit; // Total records the client may have sent so far
+};
+
+// How advertising is aimed at the last bonded central after a deep sleep wake
+enum BLEReconnectPhase {
+  BLE_RECONNECT_NONE,       // Normal undirected advertising schedule
+  BLE_RECONNECT_DIRECTED,   // Directed advertising to the last central
+  BLE_RECONNECT_WHITELIST   // Undirected, connections filtered by the whitelist
+};
+
+enum BLEConnectionProfile {
+  BLE_CONN_PROFILE_NONE,  // Whatever the central picked on connect
+  BLE_CONN_PROFILE_FAST,  // Short interval, no latency, for HID input streaming
+  BLE_CONN_PROFILE_IDLE   // Long interval with peripheral latency to save power
+};
+
+// Long-running command handed off to the executor task
+struct BLEJob {
+  uint16_t connHandle;
+  uint32_t requestId;
+  BLECommand command;
+  uint32_t timestamp;
+};
+
+// State of one connected central, indexed by its connection handle
+struct BLEClient {
+  bool active;
+  uint16_t connHandle;
+  uint16_t mtu;
+  uint32_t connectLatencyMs;
+
+  // Radio link, PHY is BLE_GAP_LE_PHY_1M/2M/CODED, dataLen is the accepted LL payload request
+  uint8_t txPhy;
+  uint8_t rxPhy;
+  uint16_t dataLen;
+
+  // Connection parameter management
+  BLEConnectionProfile profile;
+  bool profileRetryPending;
+  uint32_t profileRequestTime;
+  uint32_t lastHIDActivityTime;
+  uint16_t interval;
+  uint16_t latency;
+  uint16_t timeout;
+  uint32_t paramUpdates;
+
+  TelemetrySubscription telemetry;
+
+  // Client clock, offset is device millis() minus client ms
+  bool clockSynced;
+  int32_t clockOffset;
+
+  // Input stream accounting, acked cumulatively
+  bool inputStarted;
+  bool inputSubscribed;
+  bool inputAckPending;
+  uint32_t inputRecords;              // Records received, including overruns
+  uint32_t inputCreditsAtLastAck;
+  uint32_t lastInputAckTime;
+  BLEInputAck inputAck;
+};
+
 class BLEManager {
 private:
-  BLEServer* pServer;
-  BLEService* pService;
-  BLECharacteristic* pTxCharacteristic;
-  BLECharacteristic* pRxCharacteristic;
+  NimBLEServer* pServer;
+  NimBLEService* pService;
+  NimBLECharacteristic* pTxCharacteristic;
+  NimBLECharacteristic* pRxCharacteristic;
+  NimBLECharacteristic* pTelemetryCharacteristic;
+  NimBLECharacteristic* pPowerStatusCharacteristic;
+  NimBLECharacteristic* pInputCharacteristic;
+  NimBLEService* pBatteryService;
+  NimBLECharacteristic* pBatteryLevelCharacteristic;
 
+  // Last values written to the cached power characteristics
+  int16_t cachedBatteryLevel;
+  uint8_t cachedPowerStatus[BLE_TELEMETRY_MAX_PACKET_SIZE];
+  size_t cachedPowerStatusLength;
+
+  // Advertisement telemetry, PowerManager posts the wanted values and the BLE task applies them
+  int16_t advertisedBatteryLevel;   // Only set once the advertisement actually carries it
+  int16_t advertisedState;
+  volatile uint8_t pendingAdvBatteryLevel;
+  volatile uint8_t pendingAdvState;
+  volatile bool advertisementPending;
   QueueHandle_t commandQueue;
+  QueueHandle_t jobQueue;
   SemaphoreHandle_t bleMutex;
+  SemaphoreHandle_t clientMutex;    // Guards clients, written from the NimBLE host task
+  TaskHandle_t executorTaskHandle;
+  uint32_t nextRequestId;
+
+  BLEClient clients[BLE_MAX_CONNECTIONS];
+  volatile uint8_t connectedCount;
+  uint8_t oldConnectedCount;
 
-  bool deviceConnected;
-  bool oldDeviceConnected;
+  // Stack footprint and startup diagnostics
+  uint32_t initDurationMs;
+  uint32_t initHeapUsage;
+  uint32_t advertisingStartTime;   // Start of the current fast-then-backoff advertising burst
+  uint16_t advertisingInterval;     // Interval advertising currently runs with, 0 when stopped
+
+  // Wake reconnect toward the last bonded central
+  NimBLEAddress lastPeerAddress;
+  bool hasLastPeer;
+  BLEReconnectPhase reconnectPhase;
+  uint32_t reconnectPhaseStartTime;
+  bool wokeFromDeepSleep;
+  uint32_t wakeToConnectMs;                 // millis() since boot at the first connection after wake
+  BLEReconnectPhase wakeConnectPhase;       // Phase that produced that connection
 
   void processCommands();
   void handleCommand(const BLEMessage& message);
   void parseCommand(const char* data, BLEMessage& message);
   bool parseDataComponents(const char* data, BLEMessage& message);
 
-  class ServerCallbacks : public BLEServerCallbacks {
+  BLEClient* findClient(uint16_t connHandle);
+  BLEClient* addClient(uint16_t connHandle);
+  void removeClient(uint16_t connHandle);
+
+  bool isHIDCommand(BLECommand command) const;
+  bool buildHIDMessage(const BLEMessage& message, HIDMessage& hidMessage) const;
+  bool isBatch(const char* data) const;
+  void handleBatch(const BLEMessage& message);
+  void notifyHIDActivity(uint16_t connHandle);
+  void updateConnectionProfiles();
+  void requestConnectionProfile(BLEClient& client, BLEConnectionProfile profile);
+  const char* getBLEInfo(uint16_t connHandle);
+  void startAdvertising(uint16_t interval);
+  void restartAdvertisingBurst();
+  void updateAdvertisingSchedule();
+  void refreshAdvertisementData();
+  uint16_t getScheduledAdvertisingInterval(uint32_t elapsed, bool powerSaving) const;
+
+  bool loadLastPeer();
+  void saveLastPeer(const NimBLEAddress& address);
+  void startReconnect();
+  void updateReconnect();
+  void endReconnect();
+  bool updateAdvertisementData(uint8_t batteryLevel, uint8_t state);
+  void negotiateLink(BLEClient& client);
+
+  bool syncClientClock(uint16_t connHandle, uint32_t clientTime);
+  uint32_t toDeviceTime(const BLEClient& client, uint16_t clientTime) const;
+
+  static int getInputRecordLength(uint8_t type);
+  void handleInputPacket(BLEClient& client, const uint8_t* data, size_t length);
+  bool dispatchInputRecord(uint8_t type, const uint8_t* payload, uint32_t timestamp);
+  void grantInputCredits();
+  void sendInputAcks();
+
+  bool setTelemetrySubscription(uint16_t connHandle, uint8_t fields, uint32_t periodMs, uint16_t voltageThresholdMv, uint16_t currentThresholdMa, uint8_t percentageThreshold);
+  void clearTelemetrySubscription(uint16_t connHandle);
+
+  bool isLongRunningCommand(BLECommand command) const;
+  bool dispatchJob(const BLEMessage& message);
+  void executeJob(const BLEJob& job);
+  static void executorTask(void* arg);
+
+  class ServerCallbacks : public NimBLEServerCallbacks {
   public:
     ServerCallbacks(BLEManager* manager) : manager(manager) {}
-    void onConnect(BLEServer* server) override;
-    void onDisconnect(BLEServer* server) override;
+    void onConnect(NimBLEServer* server, NimBLEConnInfo& connInfo) override;
+    void onDisconnect(NimBLEServer* server, NimBLEConnInfo& connInfo, int reason) override;
+    void onMTUChange(uint16_t mtu, NimBLEConnInfo& connInfo) override;
+    void onConnParamsUpdate(NimBLEConnInfo& connInfo) override;
+    void onPhyUpdate(NimBLEConnInfo& connInfo, uint8_t txPhy, uint8_t rxPhy) override;
+    void onAuthenticationComplete(NimBLEConnInfo& connInfo) override;
   private:
     BLEManager* manager;
   };
 
-  class CharacteristicCallbacks : public BLECharacteristicCallbacks {
+  class CharacteristicCallbacks : public NimBLECharacteristicCallbacks {
   public:
     CharacteristicCallbacks(BLEManager* manager) : manager(manager) {}
-    void onWrite(BLECharacteristic* characteristic) override;
+    void onWrite(NimBLECharacteristic* characteristic, NimBLEConnInfo& connInfo) override;
+  private:
+    BLEManager* manager;
+  };
+
+  class InputCallbacks : public NimBLECharacteristicCallbacks {
+  public:
+    InputCallbacks(BLEManager* manager) : manager(manager) {}
+    void onWrite(NimBLECharacteristic* characteristic, NimBLEConnInfo& connInfo) override;
+    void onSubscribe(NimBLECharacteristic* characteristic, NimBLEConnInfo& connInfo, uint16_t subValue) override;
   private:
     BLEManager* manager;
   };
 
   ServerCallbacks* serverCallbacks;
   CharacteristicCallbacks* rxCallbacks;
+  InputCallbacks* inputCallbacks;
 public:
   BLEManager();
   ~BLEManager();
@@ -180,9 +439,12 @@ public:
   bool begin();
   void update();
 
-  bool sendResponse(const char* response);
+  bool sendResponse(uint16_t connHandle, const char* response);
+  void publishTelemetry(const PowerTelemetrySample& sample);
+  void updatePowerStatus(const PowerTelemetrySample& sample);
 
-  bool isConnected() const { return deviceConnected; }
+  bool isConnected() const { return connectedCount > 0; }
+  uint8_t getConnectedCount() const { return connectedCount; }
   void disconnect();
 };
 
@@ -90,6 +90,51 @@ struct PowerData {
   }
 };
 
+// Fields selectable by a POWER_SUBSCRIBE client, packed in this order after the field mask byte
+enum TelemetryField : uint8_t {
+  TELEMETRY_FIELD_BATTERY_VOLTAGE = 0x01,     // uint16_t, mV
+  TELEMETRY_FIELD_BATTERY_CURRENT = 0x02,     // int16_t, mA
+  TELEMETRY_FIELD_BATTERY_PERCENTAGE = 0x04,  // uint8_t, %
+  TELEMETRY_FIELD_CHARGER_VOLTAGE = 0x08,     // uint16_t, mV
+  TELEMETRY_FIELD_CHARGER_CURRENT = 0x10,     // int16_t, mA
+  TELEMETRY_FIELD_TIME_TO_DISCHARGE = 0x20,   // uint32_t, s
+  TELEMETRY_FIELD_TIME_TO_CHARGE = 0x40,      // uint32_t, s
+  TELEMETRY_FIELD_STATE = 0x80,               // uint8_t, TelemetryState flags
+  TELEMETRY_FIELDS_ALL = 0xFF
+};
+
+enum TelemetryState : uint8_t {
+  TELEMETRY_STATE_CHARGING = 0x01,
+  TELEMETRY_STATE_SBC_POWERED = 0x02,
+  TELEMETRY_STATE_POWER_SAVING = 0x04
+};
+
+// Integer scaled snapshot of PowerData, cheap to compare and to pack
+struct PowerTelemetrySample {
+  uint16_t batteryVoltageMv;
+  int16_t batteryCurrentMa;
+  uint8_t batteryPercentage;
+  uint16_t chargerVoltageMv;
+  int16_t chargerCurrentMa;
+  uint32_t toFullyDischargeS;
+  uint32_t toFullyChargeS;
+  uint8_t state;
+};
+
+// Per-connection subscription, owned by BLEManager
+struct TelemetrySubscription {
+  bool active;
+  uint8_t fields;
+  uint32_t periodMs;
+  uint16_t voltageThresholdMv;
+  uint16_t currentThresholdMa;
+  uint8_t percentageThreshold;
+
+  bool hasSent;
+  uint32_t lastSentTime;
+  PowerTelemetrySample lastSent;
+};
+
 class PowerManager {
 private:
   PowerData powerData = { { 0.0f, 0.0f, 0.0f, 0 }, { 0.0f, 0.0f, 0.0f, false }, 0, false };
@@ -127,6 +172,8 @@ private:
   uint32_t calculateEstimatedTimeToFullyCharge(float chargerCurrent, float chargerVoltage, float batteryCurrent, float batteryVoltage, float percentage);
 
   uint32_t calculateEstimatedTimeToFullyDischarge(float chargerCurrent, float chargerVoltage, float batteryCurrent, float batteryVoltage, float percentage);
+
+  void publishTelemetry(const PowerData& data);
 public:
   PowerManager();
   ~PowerManager();
@@ -182,6 +229,11 @@ public:
     return isPowerSaving;
   }
 
+  PowerTelemetrySample buildTelemetrySample(const PowerData& data) const;
+  static bool isTelemetryDue(const TelemetrySubscription& subscription, const PowerTelemetrySample& sample, uint32_t now);
+  static bool isTimeEstimateChanged(uint32_t seconds, uint32_t lastSeconds);
+  static size_t packTelemetry(uint8_t fields, const PowerTelemetrySample& sample, uint8_t* buffer, size_t bufferSize);
+
   void setLEDPower(uint8_t brightness);
   void enableLEDs(bool enable);
   bool areLEDsEnabled() const { return ledsEnabled; }
@@ -13,8 +13,14 @@
 #include <USB.h>
 
 #include <classes/GripDeckVendorHID.h>
+#include <classes/HIDTimerWheel.h>
+#include <classes/HIDTextPool.h>
+#include <classes/HIDTypingEngine.h>
+#include <classes/HIDNKROKeyboard.h>
+#include <classes/HIDRateMeter.h>
+#include <classes/HIDAbsolutePointer.h>
 
-enum HIDCommand {
+enum HIDCommand : uint8_t {
   HID_KEYBOARD_PRESS,
   HID_KEYBOARD_HOLD,
   HID_KEYBOARD_RELEASE,
@@ -31,15 +37,99 @@ enum HIDCommand {
   HID_GAMEPAD_AXIS_RIGHT,
   HID_GAMEPAD_AXIS_LEFT,
   HID_SYSTEM_POWER,
+  HID_MOUSE_VELOCITY,       // x, y in px/s until duration ms pass or the next velocity command
+  HID_GAMEPAD_AXIS_TARGET,  // Ramp stick key (0 left, 1 right) to x, y over duration ms
+  HID_KEYBOARD_REPORT,      // Whole report in report, replaces the device state
+  HID_MOUSE_REPORT,
+  HID_GAMEPAD_REPORT,
+  HID_POINTER_MOVE,         // x, y on the client surface (read as uint16_t), buttons held
 };
 
+enum HIDStick : uint8_t {
+  HID_STICK_LEFT = 0,
+  HID_STICK_RIGHT = 1
+};
+
+// Complete reports as the interfaces send them, for clients that track the full device state themselves
+struct __attribute__((packed)) HIDMouseReport {
+  uint8_t buttons;
+  int8_t x, y;
+  int8_t wheel, pan;
+};
+
+struct __attribute__((packed)) HIDGamepadReport {
+  int8_t leftX, leftY;
+  int8_t rightX, rightY;
+  int8_t leftTrigger, rightTrigger;
+  uint8_t hat;          // 0 centered, 1 up, then clockwise to 8 up-left
+  uint32_t buttons;     // Bit 0 is button 1
+};
+
+#define HID_RAW_REPORT_SIZE 12
+
+// Queued by value, so it stays small; text lives in the USBManager text pool
 struct HIDMessage {
   HIDCommand command;
   uint8_t key;
-  int16_t x, y;
   uint8_t buttons;
-  char text[64];
-  uint32_t timestamp;
+  union {
+    struct {
+      uint16_t duration;    // Velocity timeout or axis ramp time (ms)
+      int16_t x, y;
+      uint16_t textLength;
+      union {
+        const char* text;     // Set by the producer, not NUL terminated; queueHIDMessages copies it into the pool
+        uint16_t textOffset;  // Once queued
+      };
+    };
+    uint8_t report[HID_RAW_REPORT_SIZE];  // HID_*_REPORT commands
+  };
+  uint32_t timestamp;   // When the event was produced, device millis(); the jitter buffer plays it out at timestamp + delay
+};
+
+static_assert(sizeof(KeyReport) <= HID_RAW_REPORT_SIZE && sizeof(HIDGamepadReport) <= HID_RAW_REPORT_SIZE,
+  "Raw reports must fit in HIDMessage");
+
+// Outcome of queueHIDMessages, decided under the queue mutex so a full queue is never reported as a bad command
+enum HIDQueueResult {
+  HID_QUEUE_OK,
+  HID_QUEUE_BUSY,       // No room in the queue or text pool right now, nothing was queued
+  HID_QUEUE_INVALID     // Malformed message or HID not ready, retrying won't help
+};
+
+// Reports generated locally every mouse or gamepad report interval, so continuous motion needs one BLE command instead of a stream
+struct MouseMotion {
+  bool active;
+  int16_t velocityX;        // px/s
+  int16_t velocityY;
+  uint32_t lastFrameTime;
+  uint32_t endTime;
+  int32_t remainderX;       // Sub-pixel carry, px * 1000
+  int32_t remainderY;
+  uint32_t nextFrameTime;
+};
+
+struct StickMotion {
+  bool active;
+  int16_t x, y;             // Last value sent
+  int16_t fromX, fromY;
+  int16_t toX, toY;
+  uint32_t startTime;
+  uint16_t rampMs;
+  uint32_t nextFrameTime;
+};
+
+// Playout statistics of the jitter buffer, latency is from production to the USB report
+struct HIDJitterStats {
+  uint32_t events;
+  uint32_t late;              // Events that missed their playout time
+  uint64_t totalLatencyMs;
+  uint32_t maxLatencyMs;
+  uint64_t totalJitterMs;     // Sum of |spacing on USB - spacing at the client| between consecutive events
+  uint32_t maxJitterMs;
+  bool hasLast;
+  uint32_t lastTimestamp;
+  uint32_t lastExecTime;
 };
 
 struct SystemStatus {
@@ -70,19 +160,58 @@ struct __attribute__((packed)) InfoPayload {
 class USBManager {
 private:
   USBHIDKeyboard keyboard;
+  HIDNKROKeyboard nkroKeyboard;
   USBHIDMouse mouse;
   USBHIDGamepad gamepad;
   USBHIDConsumerControl consumerControl;
+  HIDAbsolutePointer pointer;
   USBHID hid;
   GripDeckVendorHID* vendorDevice;
 
   QueueHandle_t hidQueue;
   SemaphoreHandle_t hidMutex;
+  SemaphoreHandle_t queueMutex;     // Serializes producers so a batch is never interleaved with other commands
 
   bool usbConnected = false;
+  bool nkroActive = USB_NKRO_ENABLED; // Key state goes to nkroKeyboard instead of the 6KRO keyboard
+
+  // Device state kept here rather than in the Arduino wrappers, so raw reports and single key or button
+  // commands build on each other. The wrappers only carry the reports to the host.
+  KeyReport keyboardReport = {};
+  uint8_t mouseButtons = 0;
   bool initialized = false;
   uint32_t sequenceCounter = 0;
 
+  // Jitter buffer, settings and stats are guarded by queueMutex
+  bool jitterEnabled = false;
+  uint16_t jitterDelayMs = USB_JITTER_DEFAULT_DELAY_MS;
+  HIDJitterStats jitterStats = {};
+  volatile uint32_t nextPlayoutTime = 0;
+  volatile bool playoutPending = false;
+
+  // Pending releases of timed presses, only touched from the USB task under hidMutex
+  HIDTimerWheel releaseTimers;
+
+  // Text of queued typing messages, guarded by queueMutex
+  HIDTextPool textPool;
+
+  // Types the text of one HID_KEYBOARD_TYPE message at a time, the queue waits behind it
+  HIDTypingEngine typing;
+
+  // Report pacing and measurement per device, guarded by hidMutex
+  uint8_t reportIntervalMs[HID_REPORT_DEVICE_COUNT] = {
+    USB_REPORT_INTERVAL_KEYBOARD_MS, USB_REPORT_INTERVAL_MOUSE_MS, USB_REPORT_INTERVAL_GAMEPAD_MS, 0  // Pointer is not paced
+  };
+  HIDRateMeter rateMeter;
+
+  // Client surface mapped onto the absolute pointer, guarded by hidMutex
+  uint16_t pointerSurfaceWidth = USB_POINTER_MAX_SURFACE;
+  uint16_t pointerSurfaceHeight = USB_POINTER_MAX_SURFACE;
+
+  // Motion engine, only touched from the USB task
+  MouseMotion mouseMotion = {};
+  StickMotion stickMotion[2] = {};
+
   // Vendor protocol response storage
   VendorPacket vendorResponse;
   bool vendorResponseReady = false;
@@ -92,12 +221,35 @@ private:
 private:
   void processHIDCommands();
   void executeHIDCommand(const HIDMessage& command);
+  void recordPlayout(const HIDMessage& message, uint32_t now);
+  bool isPlayoutDue(const HIDMessage& message, uint32_t now) const;
+  bool coalesceHIDMessage(HIDMessage& message, const HIDMessage& next);
+  void updateMotion();
+  uint8_t getReleaseTimerCount(const HIDMessage& message) const;
+  void pressWithRelease(HIDTimerAction action, uint8_t code, uint16_t holdMs);
+  void cancelRelease(HIDTimerAction action, uint8_t code);
+  void fireRelease(const HIDTimer& timer);
+  void processReleaseTimers();
+  void updateTyping();
+  void sendRawReport(const HIDMessage& command);
+  void pressKey(uint8_t key);
+  void releaseKey(uint8_t key);
+  void sendKeyboardFrame(KeyReport& report);
+  void sendMouseMove(int8_t x, int8_t y, int8_t wheel, int8_t pan);
+  void setMouseButtons(uint8_t buttons);
+  void loadKeyboardLayout();
+  void releaseText(uint16_t length);
+  void setGamepadButton(uint8_t button, bool pressed);
+  void setStick(uint8_t stick, int16_t x, int16_t y);
+  bool isFrameDue(uint32_t& nextFrameTime, HIDReportDevice device, uint32_t now);
+  bool isMotionActive() const { return mouseMotion.active || stickMotion[HID_STICK_LEFT].active || stickMotion[HID_STICK_RIGHT].active; }
   void checkInitialUSBStatus();
   void handleUSBEvent(arduino_usb_event_t event, void* event_data);
   bool initializeFreeRTOSResources();
 
   bool isValidKey(uint8_t key);
   bool isValidMouseButton(uint8_t button);
+  bool isValidHIDMessage(const HIDMessage& message);
 
   void sendVendorResponse(const VendorPacket& request, VendorResponse response_type, const void* payload, size_t payload_size);
   void handlePingCommand(const VendorPacket& request);
@@ -119,10 +271,25 @@ public:
   bool begin();
   void update();
 
+  HIDQueueResult queueHIDMessages(const HIDMessage* messages, size_t count);
+
+  bool setTypingRate(uint16_t charsPerSecond) { return typing.setRate(charsPerSecond); }
+  bool setKeyboardLayout(HIDLayoutId layout, HIDUnicodeMode unicodeMode);
+  bool setNKROEnabled(bool enabled);
+  void clearTypingCarry();
+  const char* getTypingInfo();
+
+  bool setJitterBuffer(bool enabled, uint16_t delayMs);
+  const char* getJitterInfo();
+  uint32_t getIdleDelay() const;
+
+  bool setReportInterval(HIDReportDevice device, uint16_t intervalMs);
+  bool setRateMeasurement(bool enabled);
+  const char* getRateInfo();
+
   bool sendKeyPress(uint8_t key);
   bool sendKeyHold(uint8_t key);
   bool sendKeyRelease(uint8_t key);
-  bool typeText(const char* text);
 
   bool sendMouseMove(int16_t x, int16_t y);
   bool sendMousePress(uint8_t button);
@@ -136,7 +303,15 @@ public:
 
   bool sendSystemPowerKey();
 
+  bool setPointerSurface(uint16_t width, uint16_t height);
+  uint16_t getPointerSurfaceWidth() const { return pointerSurfaceWidth; }
+  uint16_t getPointerSurfaceHeight() const { return pointerSurfaceHeight; }
+
   bool isUSBConnected() const { return usbConnected; }
+  bool isNKROActive() const { return nkroActive; }
+
+  uint16_t getHIDQueueSpace() const { return hidQueue ? uxQueueSpacesAvailable(hidQueue) : 0; }
+  uint16_t getHIDQueueCapacity() const { return QUEUE_SIZE_HID; }
 };
 
 #endif // USB_MANAGER_H
\ No newline at end of file
@@ -0,0 +1,61 @@
+// src/classes/HIDAbsolutePointer.cpp
+#include <classes/HIDAbsolutePointer.h>
+#include <utils/DebugSerial.h>
+#include <cstring>
+
+const uint8_t pointerReportDescriptor[] = {
+  0x05, 0x01,        // Usage Page (Generic Desktop)
+  0x09, 0x02,        // Usage (Mouse)
+  0xA1, 0x01,        // Collection (Application)
+  0x85, USB_POINTER_REPORT_ID,  // Report ID
+  0x09, 0x01,        //   Usage (Pointer)
+  0xA1, 0x00,        //   Collection (Physical)
+  0x05, 0x09,        //     Usage Page (Button)
+  0x19, 0x01,        //     Usage Minimum (1)
+  0x29, 0x03,        //     Usage Maximum (3)
+  0x15, 0x00,        //     Logical Minimum (0)
+  0x25, 0x01,        //     Logical Maximum (1)
+  0x75, 0x01,        //     Report Size (1)
+  0x95, 0x03,        //     Report Count (3)
+  0x81, 0x02,        //     Input (Data,Var,Abs)
+  0x75, 0x05,        //     Report Size (5)
+  0x95, 0x01,        //     Report Count (1)
+  0x81, 0x03,        //     Input (Const,Var,Abs)
+  0x05, 0x01,        //     Usage Page (Generic Desktop)
+  0x09, 0x30,        //     Usage (X)
+  0x09, 0x31,        //     Usage (Y)
+  0x15, 0x00,        //     Logical Minimum (0)
+  0x26, USB_POINTER_LOGICAL_MAX & 0xFF, USB_POINTER_LOGICAL_MAX >> 8,  // Logical Maximum
+  0x75, 0x10,        //     Report Size (16)
+  0x95, 0x02,        //     Report Count (2)
+  0x81, 0x02,        //     Input (Data,Var,Abs)
+  0xC0,              //   End Collection
+  0xC0,              // End Collection
+};
+
+const size_t pointerReportDescriptorSize = sizeof(pointerReportDescriptor);
+
+HIDAbsolutePointer::HIDAbsolutePointer() : hid() {
+  static bool initialized = false;
+  if (!initialized) {
+    initialized = true;
+    DEBUG_PRINTF("Adding absolute pointer HID device with descriptor size: %d\n", pointerReportDescriptorSize);
+    if (!USBHID::addDevice(this, pointerReportDescriptorSize)) {
+      DEBUG_PRINTLN("ERROR: Failed to add absolute pointer HID device");
+    }
+  }
+}
+
+void HIDAbsolutePointer::begin() {
+  hid.begin();
+}
+
+uint16_t HIDAbsolutePointer::_onGetDescriptor(uint8_t* buffer) {
+  memcpy(buffer, pointerReportDescriptor, sizeof(pointerReportDescriptor));
+  return sizeof(pointerReportDescriptor);
+}
+
+bool HIDAbsolutePointer::move(uint16_t x, uint16_t y, uint8_t buttons) {
+  HIDPointerReport report = { (uint8_t)(buttons & 0x07), x, y };
+  return hid.SendReport(USB_POINTER_REPORT_ID, &report, sizeof(report));
+}
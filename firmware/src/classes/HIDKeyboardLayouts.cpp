@@ -0,0 +1,179 @@
+// src/classes/HIDKeyboardLayouts.cpp
+#include <classes/HIDKeyboardLayouts.h>
+#include <array>
+#include <cstring>
+#include <strings.h>
+
+// Tables are built at compile time: US from a compact ASCII map, the others as US plus the keys that differ.
+// Each one is a flat array indexed by code point, so a lookup is a bounds check and a load.
+
+using HIDLayoutTable = std::array<HIDKeyStroke, HID_LAYOUT_CODE_POINTS>;
+
+struct HIDLayoutKey {
+  uint16_t codePoint;
+  uint8_t keycode;
+  uint8_t modifiers;
+};
+
+struct HIDKeyboardLayout {
+  const char* name;
+  HIDLayoutTable table;
+  HIDKeyStroke euro;    // U+20AC is the only common character past the direct lookup range
+};
+
+#define S   HID_MODIFIER_LEFT_SHIFT
+#define AG  HID_MODIFIER_RIGHT_ALT
+#define D   HID_STROKE_DEAD
+
+// US ASCII, usage | 0x80 when typed with shift
+static constexpr uint8_t usAscii[128] = {
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // NUL .. BEL
+  0x2A, 0x2B, 0x28, 0x00, 0x00, 0x28, 0x00, 0x00,  // BS, TAB, LF, CR
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x29, 0x00, 0x00, 0x00, 0x00,  // ESC
+  0x2C, 0x9E, 0xB4, 0xA0, 0xA1, 0xA2, 0xA4, 0x34,  // space ! " # $ % & '
+  0xA6, 0xA7, 0xA5, 0xAE, 0x36, 0x2D, 0x37, 0x38,  // ( ) * + , - . /
+  0x27, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24,  // 0 .. 7
+  0x25, 0x26, 0xB3, 0x33, 0xB6, 0x2E, 0xB7, 0xB8,  // 8 9 : ; < = > ?
+  0x9F, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8A,  // @ A .. G
+  0x8B, 0x8C, 0x8D, 0x8E, 0x8F, 0x90, 0x91, 0x92,  // H .. O
+  0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A,  // P .. W
+  0x9B, 0x9C, 0x9D, 0x2F, 0x31, 0x30, 0xA3, 0xAD,  // X Y Z [ \ ] ^ _
+  0x35, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A,  // ` a .. g
+  0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11, 0x12,  // h .. o
+  0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A,  // p .. w
+  0x1B, 0x1C, 0x1D, 0xAF, 0xB1, 0xB0, 0xB5, 0x00   // x y z { | } ~ DEL
+};
+
+static constexpr HIDLayoutKey ukKeys[] = {
+  { '"', 0x1F, S }, { '@', 0x34, S }, { '#', 0x32, 0 }, { '~', 0x32, S },
+  { '\\', 0x64, 0 }, { '|', 0x64, S },
+  { 0x00A3, 0x20, S },    // £
+  { 0x00AC, 0x35, S },    // ¬
+  { 0x00A6, 0x35, AG },   // ¦
+};
+
+static constexpr HIDLayoutKey deKeys[] = {
+  { 'y', 0x1D, 0 }, { 'z', 0x1C, 0 }, { 'Y', 0x1D, S }, { 'Z', 0x1C, S },
+  { '"', 0x1F, S }, { '#', 0x32, 0 }, { '&', 0x23, S }, { '\'', 0x32, S },
+  { '(', 0x25, S }, { ')', 0x26, S }, { '*', 0x30, S }, { '+', 0x30, 0 },
+  { '-', 0x38, 0 }, { '/', 0x24, S }, { ':', 0x37, S }, { ';', 0x36, S },
+  { '<', 0x64, 0 }, { '=', 0x27, S }, { '>', 0x64, S }, { '?', 0x2D, S },
+  { '@', 0x14, AG }, { '[', 0x25, AG }, { '\\', 0x2D, AG }, { ']', 0x26, AG },
+  { '^', 0x35, D }, { '_', 0x38, S }, { '`', 0x2E, S | D }, { '{', 0x24, AG },
+  { '|', 0x64, AG }, { '}', 0x27, AG }, { '~', 0x30, AG },
+  { 0x00A7, 0x20, S },    // §
+  { 0x00B0, 0x35, S },    // °
+  { 0x00B2, 0x1F, AG },   // ²
+  { 0x00B3, 0x20, AG },   // ³
+  { 0x00B4, 0x2E, D },    // ´
+  { 0x00B5, 0x10, AG },   // µ
+  { 0x00C4, 0x34, S }, { 0x00D6, 0x33, S }, { 0x00DC, 0x2F, S },  // Ä Ö Ü
+  { 0x00DF, 0x2D, 0 },    // ß
+  { 0x00E4, 0x34, 0 }, { 0x00F6, 0x33, 0 }, { 0x00FC, 0x2F, 0 },  // ä ö ü
+};
+
+static constexpr HIDLayoutKey plKeys[] = {
+  { 0x0105, 0x04, AG }, { 0x0104, 0x04, AG | S },   // ą Ą
+  { 0x0107, 0x06, AG }, { 0x0106, 0x06, AG | S },   // ć Ć
+  { 0x0119, 0x08, AG }, { 0x0118, 0x08, AG | S },   // ę Ę
+  { 0x0142, 0x0F, AG }, { 0x0141, 0x0F, AG | S },   // ł Ł
+  { 0x0144, 0x11, AG }, { 0x0143, 0x11, AG | S },   // ń Ń
+  { 0x00F3, 0x12, AG }, { 0x00D3, 0x12, AG | S },   // ó Ó
+  { 0x015B, 0x16, AG }, { 0x015A, 0x16, AG | S },   // ś Ś
+  { 0x017A, 0x1B, AG }, { 0x0179, 0x1B, AG | S },   // ź Ź
+  { 0x017C, 0x1D, AG }, { 0x017B, 0x1D, AG | S },   // ż Ż
+};
+
+static constexpr HIDLayoutTable buildUSTable() {
+  HIDLayoutTable table = {};
+  for (size_t c = 0; c < sizeof(usAscii); c++) {
+    table[c] = { (uint8_t)(usAscii[c] & 0x7F), (uint8_t)((usAscii[c] & 0x80) ? S : 0) };
+  }
+  return table;
+}
+
+template <size_t N>
+static constexpr HIDLayoutTable withKeys(HIDLayoutTable table, const HIDLayoutKey(&keys)[N]) {
+  for (size_t i = 0; i < N; i++) {
+    table[keys[i].codePoint] = { keys[i].keycode, keys[i].modifiers };
+  }
+  return table;
+}
+
+static constexpr HIDLayoutTable usTable = buildUSTable();
+
+static constexpr HIDKeyboardLayout keyboardLayouts[HID_LAYOUT_COUNT] = {
+  { "US", usTable, { 0, 0 } },
+  { "UK", withKeys(usTable, ukKeys), { 0x21, AG } },
+  { "DE", withKeys(usTable, deKeys), { 0x08, AG } },
+  { "PL", withKeys(usTable, plKeys), { 0x18, AG } },
+};
+
+static_assert(keyboardLayouts[HID_LAYOUT_DE].table['z'].keycode == 0x1C, "DE layout swaps Y and Z");
+static_assert(keyboardLayouts[HID_LAYOUT_PL].table['a'].keycode == 0x04, "PL layout keeps the US base");
+
+#undef S
+#undef AG
+#undef D
+
+static const char* const unicodeModeNames[HID_UNICODE_MODE_COUNT] = { "NONE", "LINUX", "WINDOWS", "MACOS" };
+
+bool lookupKeyStroke(HIDLayoutId layout, uint32_t codePoint, HIDKeyStroke& stroke) {
+  if (layout >= HID_LAYOUT_COUNT) {
+    return false;
+  }
+
+  const HIDKeyboardLayout& keyboardLayout = keyboardLayouts[layout];
+  if (codePoint < HID_LAYOUT_CODE_POINTS) {
+    stroke = keyboardLayout.table[codePoint];
+  }
+  else if (codePoint == 0x20AC) {
+    stroke = keyboardLayout.euro;
+  }
+  else {
+    return false;
+  }
+  return stroke.keycode != 0;
+}
+
+bool lookupKeyCode(uint8_t key, HIDKeyStroke& stroke) {
+  // Same codes as USBHIDKeyboard: 0x88 and up are raw usages + 0x88, 0x80 .. 0x87 modifiers, below that US ASCII
+  if (key >= 0x88) {
+    stroke = { (uint8_t)(key - 0x88), 0 };
+    return true;
+  }
+  if (key >= 0x80) {
+    stroke = { 0, (uint8_t)(1 << (key - 0x80)) };
+    return true;
+  }
+  return lookupKeyStroke(HID_LAYOUT_US, key, stroke);
+}
+
+const char* getLayoutName(HIDLayoutId layout) {
+  return layout < HID_LAYOUT_COUNT ? keyboardLayouts[layout].name : "UNKNOWN";
+}
+
+bool parseLayoutName(const char* name, HIDLayoutId& layout) {
+  for (uint8_t i = 0; i < HID_LAYOUT_COUNT; i++) {
+    if (strcasecmp(name, keyboardLayouts[i].name) == 0) {
+      layout = (HIDLayoutId)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* getUnicodeModeName(HIDUnicodeMode mode) {
+  return mode < HID_UNICODE_MODE_COUNT ? unicodeModeNames[mode] : "UNKNOWN";
+}
+
+bool parseUnicodeModeName(const char* name, HIDUnicodeMode& mode) {
+  for (uint8_t i = 0; i < HID_UNICODE_MODE_COUNT; i++) {
+    if (strcasecmp(name, unicodeModeNames[i]) == 0) {
+      mode = (HIDUnicodeMode)i;
+      return true;
+    }
+  }
+  return false;
+}
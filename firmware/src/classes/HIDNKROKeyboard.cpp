@@ -0,0 +1,106 @@
+// src/classes/HIDNKROKeyboard.cpp
+#include <classes/HIDNKROKeyboard.h>
+#include <classes/HIDKeyboardLayouts.h>
+#include <utils/DebugSerial.h>
+#include <cstring>
+
+const uint8_t nkroReportDescriptor[] = {
+  0x05, 0x01,        // Usage Page (Generic Desktop)
+  0x09, 0x06,        // Usage (Keyboard)
+  0xA1, 0x01,        // Collection (Application)
+  0x85, USB_NKRO_REPORT_ID,  // Report ID
+  0x05, 0x07,        //   Usage Page (Keyboard/Keypad)
+  0x19, 0xE0,        //   Usage Minimum (Left Control)
+  0x29, 0xE7,        //   Usage Maximum (Right GUI)
+  0x15, 0x00,        //   Logical Minimum (0)
+  0x25, 0x01,        //   Logical Maximum (1)
+  0x75, 0x01,        //   Report Size (1)
+  0x95, 0x08,        //   Report Count (8)
+  0x81, 0x02,        //   Input (Data,Var,Abs)
+  0x19, 0x00,        //   Usage Minimum (0)
+  0x29, USB_NKRO_MAX_USAGE,  // Usage Maximum
+  0x95, HID_NKRO_KEY_BYTES * 8,  // Report Count
+  0x81, 0x02,        //   Input (Data,Var,Abs)
+  0xC0,              // End Collection
+};
+
+const size_t nkroReportDescriptorSize = sizeof(nkroReportDescriptor);
+
+static_assert((USB_NKRO_MAX_USAGE + 1) % 8 == 0, "NKRO bitmap must cover whole bytes");
+
+HIDNKROKeyboard::HIDNKROKeyboard() : hid(), report({}) {
+  static bool initialized = false;
+  if (!initialized) {
+    initialized = true;
+    DEBUG_PRINTF("Adding NKRO keyboard HID device with descriptor size: %d\n", nkroReportDescriptorSize);
+    if (!USBHID::addDevice(this, nkroReportDescriptorSize)) {
+      DEBUG_PRINTLN("ERROR: Failed to add NKRO keyboard HID device");
+    }
+  }
+}
+
+void HIDNKROKeyboard::begin() {
+  hid.begin();
+}
+
+uint16_t HIDNKROKeyboard::_onGetDescriptor(uint8_t* buffer) {
+  memcpy(buffer, nkroReportDescriptor, sizeof(nkroReportDescriptor));
+  return sizeof(nkroReportDescriptor);
+}
+
+bool HIDNKROKeyboard::setKey(uint8_t key, bool pressed) {
+  HIDKeyStroke stroke;
+  if (!lookupKeyCode(key, stroke)) {
+    return false;
+  }
+  uint8_t usage = stroke.keycode;
+  uint8_t modifiers = stroke.modifiers;
+
+  if (usage > USB_NKRO_MAX_USAGE) {
+    return false;
+  }
+
+  if (pressed) {
+    report.modifiers |= modifiers;
+    if (usage) {
+      report.keys[usage / 8] |= 1 << (usage % 8);
+    }
+  }
+  else {
+    report.modifiers &= ~modifiers;
+    if (usage) {
+      report.keys[usage / 8] &= ~(1 << (usage % 8));
+    }
+  }
+  return true;
+}
+
+bool HIDNKROKeyboard::press(uint8_t key) {
+  return setKey(key, true) && sendReport();
+}
+
+bool HIDNKROKeyboard::release(uint8_t key) {
+  return setKey(key, false) && sendReport();
+}
+
+void HIDNKROKeyboard::releaseAll() {
+  report = {};
+  sendReport();
+}
+
+bool HIDNKROKeyboard::sendReport(const KeyReport& keyReport) {
+  // 6KRO report to bitmap, replacing the whole state
+  report = {};
+  report.modifiers = keyReport.modifiers;
+  for (uint8_t i = 0; i < 6; i++) {
+    uint8_t usage = keyReport.keys[i];
+    if (usage != 0 && usage <= USB_NKRO_MAX_USAGE) {
+      report.keys[usage / 8] |= 1 << (usage % 8);
+    }
+  }
+  return sendReport();
+}
+
+bool HIDNKROKeyboard::sendReport() {
+  return hid.SendReport(USB_NKRO_REPORT_ID, &report, sizeof(report));
+}
@@ -0,0 +1,46 @@
+// src/classes/HIDRateMeter.cpp
+#include <classes/HIDRateMeter.h>
+#include <strings.h>
+
+static const char* const deviceNames[HID_REPORT_DEVICE_COUNT] = { "KEYBOARD", "MOUSE", "GAMEPAD", "POINTER" };
+
+HIDRateMeter::HIDRateMeter() : enabled(false), startTime(0), stats() {
+}
+
+void HIDRateMeter::start(uint32_t now) {
+  for (HIDRateStats& deviceStats : stats) {
+    deviceStats = {};
+  }
+  startTime = now;
+  enabled = true;
+}
+
+void HIDRateMeter::recordReport(HIDReportDevice device, bool delivered) {
+  if (!enabled) {
+    return;
+  }
+  stats[device].reports++;
+  if (!delivered) {
+    stats[device].failed++;
+  }
+}
+
+void HIDRateMeter::recordMissed(HIDReportDevice device, uint32_t frames) {
+  if (enabled) {
+    stats[device].missed += frames;
+  }
+}
+
+const char* HIDRateMeter::getDeviceName(HIDReportDevice device) {
+  return device < HID_REPORT_DEVICE_COUNT ? deviceNames[device] : "UNKNOWN";
+}
+
+bool HIDRateMeter::parseDeviceName(const char* name, HIDReportDevice& device) {
+  for (uint8_t i = 0; i < HID_REPORT_DEVICE_COUNT; i++) {
+    if (strcasecmp(name, deviceNames[i]) == 0) {
+      device = (HIDReportDevice)i;
+      return true;
+    }
+  }
+  return false;
+}
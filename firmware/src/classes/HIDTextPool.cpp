@@ -0,0 +1,35 @@
+// src/classes/HIDTextPool.cpp
+#include <classes/HIDTextPool.h>
+#include <cstring>
+
+static_assert(USB_HID_TEXT_POOL_SIZE <= 0xFFFF, "Text pool offsets are uint16_t");
+
+bool HIDTextPool::allocate(const char* text, uint16_t length, uint16_t& offset) {
+  if (length > available()) {
+    return false;
+  }
+
+  // Text may wrap around the end of the buffer, readers go through copy()
+  offset = head;
+  size_t firstPart = USB_HID_TEXT_POOL_SIZE - head;
+  if (firstPart > length) {
+    firstPart = length;
+  }
+  memcpy(buffer + head, text, firstPart);
+  memcpy(buffer, text + firstPart, length - firstPart);
+
+  head = (head + length) % USB_HID_TEXT_POOL_SIZE;
+  used += length;
+  return true;
+}
+
+void HIDTextPool::release(uint16_t length) {
+  // Frees the oldest allocations
+  used -= length > used ? used : length;
+}
+
+void HIDTextPool::copy(uint16_t offset, uint16_t start, char* out, size_t count) const {
+  for (size_t i = 0; i < count; i++) {
+    out[i] = buffer[(offset + start + i) % USB_HID_TEXT_POOL_SIZE];
+  }
+}
@@ -0,0 +1,151 @@
+// src/classes/HIDTimerWheel.cpp
+#include <classes/HIDTimerWheel.h>
+
+static_assert(USB_TIMER_WHEEL_CAPACITY < 0xFF, "Timer wheel indices are uint8_t with 0xFF as the list terminator");
+
+HIDTimerWheel::HIDTimerWheel() : freeList(0), expiredList(NONE), count(0), currentTick(0), lastTickTime(0), started(false) {
+  for (uint8_t i = 0; i < USB_TIMER_WHEEL_CAPACITY; i++) {
+    entries[i] = {};
+    entries[i].next = (i + 1 < USB_TIMER_WHEEL_CAPACITY) ? i + 1 : NONE;
+  }
+  for (uint16_t i = 0; i < USB_TIMER_WHEEL_SLOTS; i++) {
+    slots[i] = NONE;
+  }
+}
+
+bool HIDTimerWheel::schedule(const HIDTimer& timer, uint32_t delayMs, uint32_t now) {
+  if (freeList == NONE) {
+    return false;
+  }
+
+  if (!started || count == 0) {
+    // Idle wheel, restart the tick clock so there is no backlog of empty ticks to walk through
+    lastTickTime = now;
+    started = true;
+  }
+  else {
+    advance(now);
+  }
+
+  // Slots fire on tick boundaries counted from lastTickTime, which can be up to a tick behind now.
+  // Measure the delay from there and round up, a release must never come early.
+  uint32_t sinceTick = now - lastTickTime;
+  uint32_t ticks = (sinceTick + delayMs + USB_TIMER_WHEEL_TICK_MS - 1) / USB_TIMER_WHEEL_TICK_MS;
+  if (ticks == 0) {
+    ticks = 1;
+  }
+
+  uint8_t index = freeList;
+  Entry& entry = entries[index];
+  freeList = entry.next;
+
+  entry.timer = timer;
+  entry.rounds = (ticks - 1) / USB_TIMER_WHEEL_SLOTS;
+  entry.active = true;
+
+  // Append, so timers sharing a slot expire in the order they were scheduled
+  uint8_t* link = &slots[(currentTick + ticks) % USB_TIMER_WHEEL_SLOTS];
+  while (*link != NONE) {
+    link = &entries[*link].next;
+  }
+  entry.next = NONE;
+  *link = index;
+  count++;
+  return true;
+}
+
+void HIDTimerWheel::remove(uint8_t index) {
+  // Not tracking which list an entry is on, so look in the expired list and every slot
+  unlink(&expiredList, index);
+  for (uint16_t slot = 0; slot < USB_TIMER_WHEEL_SLOTS; slot++) {
+    unlink(&slots[slot], index);
+  }
+
+  Entry& entry = entries[index];
+  entry.active = false;
+  entry.next = freeList;
+  freeList = index;
+  count--;
+}
+
+bool HIDTimerWheel::cancel(HIDTimerAction action, uint8_t code) {
+  for (uint8_t i = 0; i < USB_TIMER_WHEEL_CAPACITY; i++) {
+    const Entry& entry = entries[i];
+    if (entry.active && entry.timer.action == action && entry.timer.code == code) {
+      remove(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+uint8_t HIDTimerWheel::cancelAll(HIDTimerAction action) {
+  uint8_t cancelled = 0;
+  for (uint8_t i = 0; i < USB_TIMER_WHEEL_CAPACITY; i++) {
+    const Entry& entry = entries[i];
+    if (entry.active && entry.timer.action == action) {
+      remove(i);
+      cancelled++;
+    }
+  }
+  return cancelled;
+}
+
+bool HIDTimerWheel::popExpired(uint32_t now, HIDTimer& timer) {
+  if (count == 0) {
+    return false;
+  }
+
+  advance(now);
+  if (expiredList == NONE) {
+    return false;
+  }
+
+  uint8_t index = expiredList;
+  Entry& entry = entries[index];
+  expiredList = entry.next;
+
+  timer = entry.timer;
+  entry.active = false;
+  entry.next = freeList;
+  freeList = index;
+  count--;
+  return true;
+}
+
+void HIDTimerWheel::unlink(uint8_t* head, uint8_t index) {
+  for (uint8_t* link = head; *link != NONE; link = &entries[*link].next) {
+    if (*link == index) {
+      *link = entries[index].next;
+      return;
+    }
+  }
+}
+
+void HIDTimerWheel::advance(uint32_t now) {
+  while ((int32_t)(now - lastTickTime) >= USB_TIMER_WHEEL_TICK_MS) {
+    lastTickTime += USB_TIMER_WHEEL_TICK_MS;
+    currentTick++;
+
+    uint16_t slot = currentTick % USB_TIMER_WHEEL_SLOTS;
+    uint8_t* link = &slots[slot];
+    while (*link != NONE) {
+      uint8_t index = *link;
+      Entry& entry = entries[index];
+      if (entry.rounds > 0) {
+        entry.rounds--;
+        link = &entry.next;
+        continue;
+      }
+
+      // Move to the tail of the expired list so releases fire in schedule order
+      *link = entry.next;
+      entry.next = NONE;
+      uint8_t* tail = &expiredList;
+      while (*tail != NONE) {
+        tail = &entries[*tail].next;
+      }
+      *tail = index;
+    }
+  }
+}
@@ -0,0 +1,279 @@
+// src/classes/HIDTypingEngine.cpp
+#include <classes/HIDTypingEngine.h>
+#include <cstring>
+
+#define HID_KEY_U               0x18
+#define HID_KEY_SPACE           0x2C
+#define HID_KEY_KEYPAD_PLUS     0x57
+
+HIDTypingEngine::HIDTypingEngine()
+  : pool(nullptr), offset(0), length(0), position(0), active(false), carry{}, carryLength(0), carryTime(0),
+  layout(HID_LAYOUT_US), unicodeMode(HID_UNICODE_NONE),
+  sequenceLength(0), sequenceIndex(0), lastReport({}), lastKeyCount(0),
+  charsPerSecond(USB_TYPING_DEFAULT_CPS), minFrameMs(USB_REPORT_INTERVAL_KEYBOARD_MS), nextFrameTime(0), frameRemainderUs(0) {
+}
+
+void HIDTypingEngine::start(const HIDTextPool* textPool, uint16_t textOffset, uint16_t textLength, uint32_t now) {
+  // A stale lead byte would corrupt the first character of unrelated text
+  if (carryLength > 0 && (now - carryTime) > USB_TYPING_CARRY_TIMEOUT_MS) {
+    carryLength = 0;
+  }
+
+  pool = textPool;
+  offset = textOffset;
+  length = textLength;
+  position = 0;
+  active = textPool && textLength > 0;
+  sequenceLength = 0;
+  sequenceIndex = 0;
+  nextFrameTime = now;
+  frameRemainderUs = 0;
+}
+
+uint32_t HIDTypingEngine::peekCodePoint(uint8_t& size) const {
+  // Bytes held back from the previous message come first
+  uint8_t bytes[4] = {};
+  memcpy(bytes, carry, carryLength);
+  uint16_t remaining = length - position;
+  uint16_t fromPool = remaining < sizeof(bytes) - carryLength ? remaining : sizeof(bytes) - carryLength;
+  pool->copy(offset, position, (char*)bytes + carryLength, fromPool);
+  uint8_t available = carryLength + fromPool;
+
+  // UTF-8; a malformed sequence comes back as U+FFFD one byte at a time
+  size = 1;
+  if (bytes[0] < 0x80) {
+    return bytes[0];
+  }
+
+  uint8_t expected = (bytes[0] & 0xE0) == 0xC0 ? 2 : (bytes[0] & 0xF0) == 0xE0 ? 3 : (bytes[0] & 0xF8) == 0xF0 ? 4 : 0;
+  if (expected == 0) {
+    return 0xFFFD;
+  }
+
+  if (expected > available) {
+    // Cut off by the end of the message, the rest may come with the next one
+    for (uint8_t i = 1; i < available; i++) {
+      if ((bytes[i] & 0xC0) != 0x80) {
+        return 0xFFFD;
+      }
+    }
+    size = available;
+    return PARTIAL_CODE_POINT;
+  }
+
+  uint32_t codePoint = bytes[0] & (0x7F >> expected);
+  for (uint8_t i = 1; i < expected; i++) {
+    if ((bytes[i] & 0xC0) != 0x80) {
+      return 0xFFFD;
+    }
+    codePoint = (codePoint << 6) | (bytes[i] & 0x3F);
+  }
+
+  size = expected;
+  return codePoint;
+}
+
+void HIDTypingEngine::consume(uint8_t size) {
+  uint8_t fromCarry = size < carryLength ? size : carryLength;
+  memmove(carry, carry + fromCarry, carryLength - fromCarry);
+  carryLength -= fromCarry;
+  position += size - fromCarry;
+}
+
+bool HIDTypingEngine::isPressed(uint8_t keycode) const {
+  for (uint8_t i = 0; i < lastKeyCount; i++) {
+    if (lastReport.keys[i] == keycode) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void HIDTypingEngine::appendFrame(uint8_t modifiers, uint8_t keycode) {
+  if (sequenceLength >= MAX_SEQUENCE) {
+    return;
+  }
+  KeyReport& frame = sequence[sequenceLength++];
+  frame = {};
+  frame.modifiers = modifiers;
+  frame.keys[0] = keycode;
+}
+
+void HIDTypingEngine::appendHexDigits(uint32_t value, uint8_t minDigits, uint8_t heldModifiers, bool keypad) {
+  uint8_t digits = minDigits;
+  while (digits < 8 && (value >> (digits * 4)) != 0) {
+    digits++;
+  }
+
+  for (int8_t i = digits - 1; i >= 0; i--) {
+    uint8_t nibble = (value >> (i * 4)) & 0x0F;
+    uint8_t keycode;
+    if (nibble >= 10) {
+      keycode = 0x04 + nibble - 10;                     // a .. f
+    }
+    else if (keypad) {
+      keycode = nibble == 0 ? 0x62 : 0x59 + nibble - 1; // Keypad 0 .. 9
+    }
+    else {
+      keycode = nibble == 0 ? 0x27 : 0x1E + nibble - 1; // 0 .. 9
+    }
+    appendFrame(heldModifiers, keycode);
+    appendFrame(heldModifiers, 0);
+  }
+}
+
+bool HIDTypingEngine::buildSequence(uint32_t codePoint, bool mapped, const HIDKeyStroke& stroke) {
+  sequenceLength = 0;
+  sequenceIndex = 0;
+
+  if (mapped) {
+    // Dead key, the space after it produces the accent on its own
+    appendFrame(stroke.modifiers & ~HID_STROKE_DEAD, stroke.keycode);
+    appendFrame(0, 0);
+    appendFrame(0, HID_KEY_SPACE);
+    appendFrame(0, 0);
+    return true;
+  }
+
+  switch (unicodeMode) {
+  case HID_UNICODE_LINUX:
+    appendFrame(HID_MODIFIER_LEFT_CTRL | HID_MODIFIER_LEFT_SHIFT, HID_KEY_U);
+    appendFrame(0, 0);
+    appendHexDigits(codePoint, 4, 0, false);
+    appendFrame(0, HID_KEY_SPACE);
+    appendFrame(0, 0);
+    return true;
+
+  case HID_UNICODE_WINDOWS:
+    if (codePoint > 0xFFFF) {
+      return false;
+    }
+    appendFrame(HID_MODIFIER_LEFT_ALT, 0);
+    appendFrame(HID_MODIFIER_LEFT_ALT, HID_KEY_KEYPAD_PLUS);
+    appendFrame(HID_MODIFIER_LEFT_ALT, 0);
+    appendHexDigits(codePoint, 4, HID_MODIFIER_LEFT_ALT, true);
+    appendFrame(0, 0);
+    return true;
+
+  case HID_UNICODE_MACOS:
+    if (codePoint > 0xFFFF) {
+      return false;
+    }
+    appendHexDigits(codePoint, 4, HID_MODIFIER_LEFT_ALT, false);
+    appendFrame(0, 0);
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+bool HIDTypingEngine::nextFrame(uint32_t now, KeyReport& report) {
+  if (!active || (int32_t)(now - nextFrameTime) < 0) {
+    return false;
+  }
+
+  report = {};
+  uint8_t count = 0;
+  uint8_t characters = 0;
+
+  if (sequenceIndex < sequenceLength) {
+    report = sequence[sequenceIndex++];
+  }
+  else {
+    while (position < length && count < 6) {
+      uint8_t size;
+      uint32_t codePoint = peekCodePoint(size);
+      if (codePoint == PARTIAL_CODE_POINT) {
+        // Everything left is the start of one character, hold it for the next message
+        pool->copy(offset, position, (char*)carry + carryLength, length - position);
+        carryLength = size;
+        carryTime = now;
+        position = length;
+        break;
+      }
+
+      HIDKeyStroke stroke;
+      bool mapped = lookupKeyStroke(layout, codePoint, stroke);
+
+      if (!mapped || (stroke.modifiers & HID_STROKE_DEAD)) {
+        // Sequences run on their own, starting from all keys up
+        if (count > 0 || lastKeyCount > 0) {
+          break;
+        }
+        consume(size);
+        if (buildSequence(codePoint, mapped, stroke)) {
+          report = sequence[sequenceIndex++];
+          characters = 1;
+          break;
+        }
+        continue;
+      }
+
+      if (count == 0) {
+        // The first key decides the frame; if it is still down or needs other modifiers, everything goes up first
+        if (lastKeyCount > 0 && (isPressed(stroke.keycode) || stroke.modifiers != lastReport.modifiers)) {
+          break;
+        }
+        report.modifiers = stroke.modifiers;
+      }
+      else if (stroke.modifiers != report.modifiers || isPressed(stroke.keycode) || memchr(report.keys, stroke.keycode, count)) {
+        break;
+      }
+
+      report.keys[count++] = stroke.keycode;
+      consume(size);
+    }
+    characters += count;
+  }
+
+  // An empty report is either a release frame or the final release
+  if (report.modifiers == 0 && report.keys[0] == 0 && position >= length && sequenceIndex >= sequenceLength) {
+    active = false;
+  }
+
+  lastReport = report;
+  lastKeyCount = 0;
+  while (lastKeyCount < 6 && report.keys[lastKeyCount] != 0) {
+    lastKeyCount++;
+  }
+  scheduleNextFrame(now, characters);
+  return true;
+}
+
+void HIDTypingEngine::scheduleNextFrame(uint32_t now, uint8_t characters) {
+  // Paced by characters, at least one keyboard report interval apart so the host sees every report
+  frameRemainderUs += (uint32_t)characters * 1000000UL / charsPerSecond;
+  uint32_t frameMs = frameRemainderUs / 1000;
+  frameRemainderUs %= 1000;
+  nextFrameTime = now + (frameMs > minFrameMs ? frameMs : minFrameMs);
+}
+
+uint32_t HIDTypingEngine::getTimeUntilNextFrame(uint32_t now) const {
+  int32_t remaining = (int32_t)(nextFrameTime - now);
+  return remaining > 0 ? remaining : 0;
+}
+
+uint32_t HIDTypingEngine::getFrameLateness(uint32_t now) const {
+  int32_t late = (int32_t)(now - nextFrameTime);
+  return late > 0 ? late : 0;
+}
+
+bool HIDTypingEngine::setRate(uint16_t cps) {
+  if (cps < USB_TYPING_MIN_CPS || cps > USB_TYPING_MAX_CPS) {
+    return false;
+  }
+  charsPerSecond = cps;
+  return true;
+}
+
+bool HIDTypingEngine::setLayout(HIDLayoutId layoutId, HIDUnicodeMode mode) {
+  if (layoutId >= HID_LAYOUT_COUNT || mode >= HID_UNICODE_MODE_COUNT) {
+    return false;
+  }
+  layout = layoutId;
+  unicodeMode = mode;
+  // A layout switch starts a new stream of text
+  carryLength = 0;
+  return true;
+}
@@ -210,7 +210,7 @@ void setup() {
   result = xTaskCreatePinnedToCore(
     bleManagerTask,
     "BLETask",
-    TASK_STACK_SIZE_EXTRA_LARGE,
+    TASK_STACK_SIZE_LARGE,
     nullptr,
     TASK_PRIORITY_NORMAL,
     nullptr,
@@ -280,7 +280,7 @@ void usbManagerTask(void* arg) {
     usbManager->update();
 
     esp_task_wdt_reset();
-    delay(TASK_INTERVAL_USB);
+    delay(usbManager->getIdleDelay());
   }
 }
 
@@ -7,6 +7,8 @@
 #include "managers/USBManager.h"
 #include "managers/PowerManager.h"
 #include "managers/SystemManager.h"
+#include <Preferences.h>
+#include <esp_sleep.h>
 
 extern USBManager* usbManager;
 extern PowerManager* powerManager;
@@ -18,173 +20,1386 @@ BLEManager::BLEManager() :
   pService(nullptr),
   pTxCharacteristic(nullptr),
   pRxCharacteristic(nullptr),
+  pTelemetryCharacteristic(nullptr),
+  pPowerStatusCharacteristic(nullptr),
+  pInputCharacteristic(nullptr),
+  pBatteryService(nullptr),
+  pBatteryLevelCharacteristic(nullptr),
+  cachedBatteryLevel(-1),
+  cachedPowerStatusLength(0),
+  advertisedBatteryLevel(-1),
+  advertisedState(-1),
+  pendingAdvBatteryLevel(0),
+  pendingAdvState(0),
+  advertisementPending(false),
   commandQueue(nullptr),
+  jobQueue(nullptr),
   bleMutex(nullptr),
-  deviceConnected(false),
-  oldDeviceConnected(false),
+  clientMutex(nullptr),
+  executorTaskHandle(nullptr),
+  nextRequestId(1),
+  connectedCount(0),
+  oldConnectedCount(0),
+  initDurationMs(0),
+  initHeapUsage(0),
+  advertisingStartTime(0),
+  advertisingInterval(0),
+  hasLastPeer(false),
+  reconnectPhase(BLE_RECONNECT_NONE),
+  reconnectPhaseStartTime(0),
+  wokeFromDeepSleep(false),
+  wakeToConnectMs(0),
+  wakeConnectPhase(BLE_RECONNECT_NONE),
   serverCallbacks(nullptr),
-  rxCallbacks(nullptr) {
+  rxCallbacks(nullptr),
+  inputCallbacks(nullptr) {
+  for (BLEClient& client : clients) {
+    client = {};
+    client.connHandle = BLE_HS_CONN_HANDLE_NONE;
+  }
 }
 
 BLEManager::~BLEManager() {
+  if (executorTaskHandle) {
+    vTaskDelete(executorTaskHandle);
+  }
   if (commandQueue) {
     vQueueDelete(commandQueue);
   }
+  if (jobQueue) {
+    vQueueDelete(jobQueue);
+  }
   if (bleMutex) {
     vSemaphoreDelete(bleMutex);
   }
+  if (clientMutex) {
+    vSemaphoreDelete(clientMutex);
+  }
   if (serverCallbacks) {
     delete serverCallbacks;
   }
   if (rxCallbacks) {
     delete rxCallbacks;
   }
+  if (inputCallbacks) {
+    delete inputCallbacks;
+  }
 }
 
 bool BLEManager::begin() {
   DEBUG_PRINTLN("Initializing BLE Manager...");
 
+  uint32_t initStartTime = millis();
+  uint32_t heapBeforeInit = ESP.getFreeHeap();
+
   commandQueue = xQueueCreate(QUEUE_SIZE_COMMANDS, sizeof(BLEMessage));
   if (!commandQueue) {
     DEBUG_PRINTLN("ERROR: Failed to create command queue");
     return false;
   }
 
+  jobQueue = xQueueCreate(QUEUE_SIZE_JOBS, sizeof(BLEJob));
+  if (!jobQueue) {
+    DEBUG_PRINTLN("ERROR: Failed to create job queue");
+    return false;
+  }
+
   bleMutex = xSemaphoreCreateMutex();
   if (!bleMutex) {
     DEBUG_PRINTLN("ERROR: Failed to create BLE mutex");
     return false;
   }
 
-  BLEDevice::init(BLE_DEVICE_NAME);
+  clientMutex = xSemaphoreCreateMutex();
+  if (!clientMutex) {
+    DEBUG_PRINTLN("ERROR: Failed to create BLE client mutex");
+    return false;
+  }
+
+  // Power commands can block for USB_CONNECTION_TIMEOUT, so they run on their own task
+  // and never stall HID commands processed by the BLE task
+  BaseType_t result = xTaskCreatePinnedToCore(
+    executorTask,
+    "BLEExecTask",
+    TASK_STACK_SIZE_MEDIUM,
+    this,
+    TASK_PRIORITY_LOW,
+    &executorTaskHandle,
+    1
+  );
+  if (result != pdPASS) {
+    DEBUG_PRINTF("ERROR: Failed to create BLEExecTask (error code %d)\n", result);
+    return false;
+  }
+
+  if (!NimBLEDevice::init(BLE_DEVICE_NAME)) {
+    DEBUG_PRINTLN("ERROR: Failed to initialize NimBLE");
+    return false;
+  }
+
+  // Request larger MTU size to handle bigger responses
+  // This will be negotiated with the client when they connect
+  NimBLEDevice::setMTU(512); // Request up to 512 bytes MTU
+
+  // Just Works bonding with LE secure connections, NimBLE persists the keys in NVS
+  NimBLEDevice::setSecurityAuth(true, false, true);
+
+  // Prefer 2M for links the central opens, negotiateLink() asks again per connection
+  if (!NimBLEDevice::setDefaultPhy(BLE_GAP_LE_PHY_1M_MASK | BLE_PREFERRED_PHY_MASK, BLE_GAP_LE_PHY_1M_MASK | BLE_PREFERRED_PHY_MASK)) {
+    DEBUG_PRINTLN("WARNING: Failed to set default BLE PHY preference");
+  }
 
-  pServer = BLEDevice::createServer();
+  pServer = NimBLEDevice::createServer();
   serverCallbacks = new ServerCallbacks(this);
-  pServer->setCallbacks(serverCallbacks);
+  pServer->setCallbacks(serverCallbacks, false);
+  pServer->advertiseOnDisconnect(false); // Restarted from update() instead
 
+  // NimBLE adds the 0x2902 descriptor to notify characteristics on its own
   pService = pServer->createService(BLE_SERVICE_UUID);
 
   pTxCharacteristic = pService->createCharacteristic(
     BLE_CHARACTERISTIC_TX_UUID,
-    BLECharacteristic::PROPERTY_NOTIFY
+    NIMBLE_PROPERTY::NOTIFY
   );
-  pTxCharacteristic->addDescriptor(new BLE2902());
 
   pRxCharacteristic = pService->createCharacteristic(
     BLE_CHARACTERISTIC_RX_UUID,
-    BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_WRITE_NR
+    NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::WRITE_NR
   );
   rxCallbacks = new CharacteristicCallbacks(this);
   pRxCharacteristic->setCallbacks(rxCallbacks);
 
+  pTelemetryCharacteristic = pService->createCharacteristic(
+    BLE_CHARACTERISTIC_TELEMETRY_UUID,
+    NIMBLE_PROPERTY::NOTIFY
+  );
+
+  // High-rate HID input bypasses the text protocol and its per-command replies
+  pInputCharacteristic = pService->createCharacteristic(
+    BLE_CHARACTERISTIC_INPUT_UUID,
+    NIMBLE_PROPERTY::WRITE_NR | NIMBLE_PROPERTY::NOTIFY
+  );
+  inputCallbacks = new InputCallbacks(this);
+  pInputCharacteristic->setCallbacks(inputCallbacks);
+
+  // Plain GATT reads are served from these values, PowerManager refreshes them every sample
+  pPowerStatusCharacteristic = pService->createCharacteristic(
+    BLE_CHARACTERISTIC_POWER_STATUS_UUID,
+    NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY
+  );
+
   pService->start();
 
-  // Request larger MTU size to handle bigger responses
-  // This will be negotiated with the client when they connect
-  BLEDevice::setMTU(512); // Request up to 512 bytes MTU
+  pBatteryService = pServer->createService(BLE_BATTERY_SERVICE_UUID);
+  pBatteryLevelCharacteristic = pBatteryService->createCharacteristic(
+    BLE_BATTERY_LEVEL_UUID,
+    NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY
+  );
+  uint8_t initialBatteryLevel = 0;
+  pBatteryLevelCharacteristic->setValue(&initialBatteryLevel, sizeof(initialBatteryLevel));
+  pBatteryService->start();
+
+  // The 128-bit service UUID and telemetry fill the advertisement, so the name goes in the scan response
+  NimBLEAdvertising* pAdvertising = NimBLEDevice::getAdvertising();
+  if (!updateAdvertisementData(0, 0)) {
+    DEBUG_PRINTLN("ERROR: Failed to set BLE advertisement data");
+    return false;
+  }
 
-  BLEAdvertising* pAdvertising = BLEDevice::getAdvertising();
-  pAdvertising->addServiceUUID(BLE_SERVICE_UUID);
-  pAdvertising->setScanResponse(false);
-  pAdvertising->setMinPreferred(0x0);
+  NimBLEAdvertisementData scanResponseData;
+  scanResponseData.setName(BLE_DEVICE_NAME);
+  pAdvertising->setScanResponseData(scanResponseData);
+  pAdvertising->enableScanResponse(true);
 
-  BLEDevice::startAdvertising();
+  // Covers both cold boot and deep sleep wake, the firmware restarts from setup() either way
+  restartAdvertisingBurst();
 
-  DEBUG_PRINTLN("BLE Manager initialized - waiting for connections");
+  wokeFromDeepSleep = esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_UNDEFINED;
+  if (wokeFromDeepSleep && loadLastPeer()) {
+    startReconnect();
+  }
+  else {
+    updateAdvertisingSchedule();
+  }
+
+  initDurationMs = millis() - initStartTime;
+  uint32_t heapAfterInit = ESP.getFreeHeap();
+  initHeapUsage = heapBeforeInit > heapAfterInit ? heapBeforeInit - heapAfterInit : 0;
+
+  DEBUG_PRINTF("BLE Manager initialized in %lu ms using %lu bytes of heap (free: %lu) - waiting for connections\n",
+    initDurationMs, initHeapUsage, heapAfterInit);
   return true;
 }
 
+void BLEManager::startAdvertising(uint16_t interval) {
+  NimBLEAdvertising* pAdvertising = NimBLEDevice::getAdvertising();
+
+  // The interval only takes effect on (re)start
+  if (pAdvertising->isAdvertising()) {
+    pAdvertising->stop();
+  }
+  pAdvertising->setMinInterval(interval);
+  pAdvertising->setMaxInterval(interval);
+
+  if (pAdvertising->start()) {
+    advertisingInterval = interval;
+    DEBUG_VERBOSE_PRINTF("BLE advertising at %.1f ms\n", interval * 0.625f);
+  }
+  else {
+    advertisingInterval = 0;
+    DEBUG_PRINTLN("ERROR: Failed to start BLE advertising");
+  }
+}
+
+void BLEManager::restartAdvertisingBurst() {
+  advertisingStartTime = millis();
+}
+
+uint16_t BLEManager::getScheduledAdvertisingInterval(uint32_t elapsed, bool powerSaving) const {
+  uint32_t interval = powerSaving ? BLE_ADV_POWER_SAVING_FAST_INTERVAL : BLE_ADV_FAST_INTERVAL;
+  uint32_t slowInterval = powerSaving ? BLE_ADV_POWER_SAVING_SLOW_INTERVAL : BLE_ADV_SLOW_INTERVAL;
+
+  // Geometric backoff, double the interval after every step nobody connected
+  for (uint32_t steps = elapsed / BLE_ADV_BACKOFF_STEP_MS; steps > 0 && interval < slowInterval; steps--) {
+    interval *= 2;
+  }
+
+  return interval < slowInterval ? interval : slowInterval;
+}
+
+void BLEManager::updateAdvertisingSchedule() {
+  if (reconnectPhase != BLE_RECONNECT_NONE) {
+    updateReconnect();
+    return;
+  }
+
+  // No room for another central, NimBLE already stopped advertising on the last connect
+  if (connectedCount >= BLE_MAX_CONNECTIONS) {
+    advertisingInterval = 0;
+    return;
+  }
+
+  bool powerSaving = powerManager && powerManager->isPowerSavingMode();
+  uint16_t interval = getScheduledAdvertisingInterval(millis() - advertisingStartTime, powerSaving);
+
+  if (interval != advertisingInterval || !NimBLEDevice::getAdvertising()->isAdvertising()) {
+    startAdvertising(interval);
+  }
+}
+
+bool BLEManager::updateAdvertisementData(uint8_t batteryLevel, uint8_t state) {
+  // Passive scanners read this without connecting, so monitoring does not keep the deck awake
+  const uint8_t manufacturerData[] = {
+    BLE_ADV_COMPANY_ID & 0xFF,
+    (BLE_ADV_COMPANY_ID >> 8) & 0xFF,
+    BLE_ADV_TELEMETRY_VERSION,
+    batteryLevel,
+    state
+  };
+
+  NimBLEAdvertisementData advertisementData;
+  advertisementData.setFlags(BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP);
+  advertisementData.addServiceUUID(NimBLEUUID(BLE_SERVICE_UUID));
+  advertisementData.setManufacturerData(manufacturerData, sizeof(manufacturerData));
+
+  return NimBLEDevice::getAdvertising()->setAdvertisementData(advertisementData);
+}
+
+bool BLEManager::loadLastPeer() {
+  Preferences preferences;
+  if (!preferences.begin(BLE_PREFS_NAMESPACE, true)) {
+    return false;
+  }
+
+  uint8_t address[6];
+  bool found = preferences.getBytes(BLE_PREFS_LAST_PEER_KEY, address, sizeof(address)) == sizeof(address);
+  uint8_t type = preferences.getUChar(BLE_PREFS_LAST_PEER_TYPE_KEY, 0);
+  preferences.end();
+
+  if (!found) {
+    return false;
+  }
+
+  lastPeerAddress = NimBLEAddress(address, type);
+
+  // The central may have been unpaired, or NimBLE dropped the bond to make room
+  hasLastPeer = NimBLEDevice::isBonded(lastPeerAddress);
+  DEBUG_PRINTF("Last bonded BLE central: %s (%s)\n", lastPeerAddress.toString().c_str(), hasLastPeer ? "bonded" : "bond lost");
+  return hasLastPeer;
+}
+
+void BLEManager::saveLastPeer(const NimBLEAddress& address) {
+  if (hasLastPeer && address == lastPeerAddress) {
+    return;
+  }
+
+  Preferences preferences;
+  if (!preferences.begin(BLE_PREFS_NAMESPACE, false)) {
+    DEBUG_PRINTLN("ERROR: Failed to open BLE preferences");
+    return;
+  }
+
+  preferences.putBytes(BLE_PREFS_LAST_PEER_KEY, address.getVal(), 6);
+  preferences.putUChar(BLE_PREFS_LAST_PEER_TYPE_KEY, address.getType());
+  preferences.end();
+
+  lastPeerAddress = address;
+  hasLastPeer = true;
+  DEBUG_PRINTF("Saved last bonded BLE central: %s\n", address.toString().c_str());
+}
+
+void BLEManager::startReconnect() {
+  NimBLEAdvertising* pAdvertising = NimBLEDevice::getAdvertising();
+  pAdvertising->stop();
+  pAdvertising->setConnectableMode(BLE_GAP_CONN_MODE_DIR);
+
+  reconnectPhase = BLE_RECONNECT_DIRECTED;
+  reconnectPhaseStartTime = millis();
+
+  if (pAdvertising->start(BLE_RECONNECT_DIRECTED_MS, &lastPeerAddress)) {
+    advertisingInterval = BLE_ADV_FAST_INTERVAL;
+    DEBUG_PRINTF("Directed advertising to %s\n", lastPeerAddress.toString().c_str());
+  }
+  else {
+    // Fall through to the whitelist phase on the next update
+    DEBUG_PRINTLN("WARNING: Directed advertising failed to start");
+    advertisingInterval = 0;
+  }
+}
+
+void BLEManager::updateReconnect() {
+  if (connectedCount > 0) {
+    endReconnect();
+    return;
+  }
+
+  NimBLEAdvertising* pAdvertising = NimBLEDevice::getAdvertising();
+  uint32_t elapsed = millis() - reconnectPhaseStartTime;
+
+  switch (reconnectPhase) {
+  case BLE_RECONNECT_DIRECTED:
+    // Directed advertising ends on its own once the duration runs out
+    if (elapsed < BLE_RECONNECT_DIRECTED_MS && pAdvertising->isAdvertising()) {
+      return;
+    }
+
+    pAdvertising->stop();
+    pAdvertising->setConnectableMode(BLE_GAP_CONN_MODE_UND);
+    NimBLEDevice::whiteListAdd(lastPeerAddress);
+    pAdvertising->setScanFilter(false, true);
+
+    reconnectPhase = BLE_RECONNECT_WHITELIST;
+    reconnectPhaseStartTime = millis();
+    startAdvertising(BLE_ADV_FAST_INTERVAL);
+    DEBUG_PRINTLN("Whitelist advertising for the last bonded central");
+    break;
+
+  case BLE_RECONNECT_WHITELIST:
+    if (elapsed >= BLE_RECONNECT_WHITELIST_MS) {
+      DEBUG_PRINTLN("Last bonded central did not reconnect, advertising to everyone");
+      endReconnect();
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+void BLEManager::endReconnect() {
+  NimBLEAdvertising* pAdvertising = NimBLEDevice::getAdvertising();
+  pAdvertising->stop();
+  pAdvertising->setConnectableMode(BLE_GAP_CONN_MODE_UND);
+  pAdvertising->setScanFilter(false, false);
+
+  // The whitelist only served the reconnect phase, a stale entry would outlive a deleted bond
+  if (NimBLEDevice::onWhiteList(lastPeerAddress) && !NimBLEDevice::whiteListRemove(lastPeerAddress)) {
+    DEBUG_PRINTLN("WARNING: Failed to remove the last central from the whitelist");
+  }
+
+  reconnectPhase = BLE_RECONNECT_NONE;
+  advertisingInterval = 0;
+
+  // Fresh fast burst for everyone else, the schedule restarts advertising on the next update
+  if (connectedCount == 0) {
+    restartAdvertisingBurst();
+  }
+}
+
+void BLEManager::negotiateLink(BLEClient& client) {
+  // Both requests are optional, a peer without 2M or DLE simply keeps 1M PHY and 27 byte fragments
+  if (!pServer->updatePhy(client.connHandle, BLE_PREFERRED_PHY_MASK, BLE_PREFERRED_PHY_MASK, 0)) {
+    DEBUG_PRINTF("WARNING: PHY update request failed for connection %d, staying on 1M\n", client.connHandle);
+  }
+
+  if (pServer->setDataLen(client.connHandle, BLE_PREFERRED_DATA_LEN)) {
+    client.dataLen = BLE_PREFERRED_DATA_LEN;
+  }
+  else {
+    DEBUG_PRINTF("WARNING: Data length extension request failed for connection %d\n", client.connHandle);
+  }
+}
+
 void BLEManager::update() {
-  if (deviceConnected != oldDeviceConnected) {
-    if (deviceConnected) {
-      DEBUG_PRINTLN("BLE client connected");
+  uint8_t currentCount = connectedCount;
+  if (currentCount != oldConnectedCount) {
+    if (currentCount > oldConnectedCount) {
+      DEBUG_PRINTF("BLE client connected (%d/%d)\n", currentCount, BLE_MAX_CONNECTIONS);
     }
     else {
-      DEBUG_PRINTLN("BLE client disconnected");
-      BLEDevice::startAdvertising();
+      DEBUG_PRINTF("BLE client disconnected (%d/%d)\n", currentCount, BLE_MAX_CONNECTIONS);
+      // Half a character from the client that left must not prefix the next client's text
+      usbManager->clearTypingCarry();
+      // The client may be trying to come straight back
+      restartAdvertisingBurst();
     }
-    oldDeviceConnected = deviceConnected;
+    oldConnectedCount = currentCount;
   }
 
+  // NimBLE stops advertising on every connect, keep it up while there is room for another central
+  refreshAdvertisementData();
+  updateAdvertisingSchedule();
+
   processCommands();
+  sendInputAcks();
+  updateConnectionProfiles();
+}
+
+BLEClient* BLEManager::findClient(uint16_t connHandle) {
+  for (BLEClient& client : clients) {
+    if (client.active && client.connHandle == connHandle) {
+      return &client;
+    }
+  }
+  return nullptr;
+}
+
+BLEClient* BLEManager::addClient(uint16_t connHandle) {
+  BLEClient* client = findClient(connHandle);
+  if (client) {
+    return client;
+  }
+
+  for (BLEClient& slot : clients) {
+    if (!slot.active) {
+      slot = {};
+      slot.active = true;
+      slot.connHandle = connHandle;
+      connectedCount++;
+      return &slot;
+    }
+  }
+  return nullptr;
+}
+
+void BLEManager::removeClient(uint16_t connHandle) {
+  BLEClient* client = findClient(connHandle);
+  if (!client) {
+    return;
+  }
+
+  *client = {};
+  client->connHandle = BLE_HS_CONN_HANDLE_NONE;
+  connectedCount--;
 }
 
-bool BLEManager::sendResponse(const char* response) {
-  if (!deviceConnected || !pTxCharacteristic) {
-    DEBUG_PRINTLN("ERROR: Cannot send BLE response - not connected or no TX characteristic");
+bool BLEManager::isHIDCommand(BLECommand command) const {
+  switch (command) {
+  case BLE_CMD_HID_KEYBOARD_PRESS:
+  case BLE_CMD_HID_KEYBOARD_HOLD:
+  case BLE_CMD_HID_KEYBOARD_RELEASE:
+  case BLE_CMD_HID_KEYBOARD_TYPE:
+  case BLE_CMD_HID_MOUSE_MOVE:
+  case BLE_CMD_HID_MOUSE_PRESS:
+  case BLE_CMD_HID_MOUSE_HOLD:
+  case BLE_CMD_HID_MOUSE_RELEASE:
+  case BLE_CMD_HID_MOUSE_SCROLL:
+  case BLE_CMD_HID_MOUSE_VELOCITY:
+  case BLE_CMD_HID_GAMEPAD_PRESS:
+  case BLE_CMD_HID_GAMEPAD_HOLD:
+  case BLE_CMD_HID_GAMEPAD_RELEASE:
+  case BLE_CMD_HID_GAMEPAD_RIGHT_AXIS:
+  case BLE_CMD_HID_GAMEPAD_LEFT_AXIS:
+  case BLE_CMD_HID_GAMEPAD_AXIS_TARGET:
+  case BLE_CMD_HID_GAMEPAD_STATE:
+  case BLE_CMD_HID_POINTER_MOVE:
+  case BLE_CMD_HID_SYSTEM_POWER:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool BLEManager::buildHIDMessage(const BLEMessage& message, HIDMessage& hidMessage) const {
+  hidMessage = {};
+  hidMessage.timestamp = millis();
+
+  bool hasArgument = message.dataCount >= 2;
+  bool hasPair = message.dataCount >= 3;
+  uint8_t argument = hasArgument ? (uint8_t)atoi(message.parsedData[1]) : 0;
+  int16_t x = hasPair ? (int16_t)atoi(message.parsedData[1]) : 0;
+  int16_t y = hasPair ? (int16_t)atoi(message.parsedData[2]) : 0;
+
+  switch (message.command) {
+  case BLE_CMD_HID_KEYBOARD_PRESS:
+    hidMessage.command = HID_KEYBOARD_PRESS;
+    hidMessage.key = argument;
+    return hasArgument;
+
+  case BLE_CMD_HID_KEYBOARD_HOLD:
+    hidMessage.command = HID_KEYBOARD_HOLD;
+    hidMessage.key = argument;
+    return hasArgument;
+
+  case BLE_CMD_HID_KEYBOARD_RELEASE:
+    hidMessage.command = HID_KEYBOARD_RELEASE;
+    hidMessage.key = argument;
+    return hasArgument;
+
+  case BLE_CMD_HID_KEYBOARD_TYPE: {
+    hidMessage.command = HID_KEYBOARD_TYPE;
+
+    // The whole rest of the line is text, separators included. Points into message, which has to outlive
+    // the queueHIDMessages call.
+    const char* text = strchr(message.rawData, BLE_CMD_PART_SEPARATOR[0]);
+    if (!text) {
+      return false;
+    }
+    text++;
+    size_t length = strlen(text);
+    while (length > 0 && (text[length - 1] == '\n' || text[length - 1] == '\r')) {
+      length--;
+    }
+    hidMessage.text = text;
+    hidMessage.textLength = length;
+    return length > 0;
+  }
+
+  case BLE_CMD_HID_MOUSE_MOVE:
+    hidMessage.command = HID_MOUSE_MOVE;
+    hidMessage.x = x;
+    hidMessage.y = y;
+    return hasPair;
+
+  case BLE_CMD_HID_MOUSE_PRESS:
+    hidMessage.command = HID_MOUSE_PRESS;
+    hidMessage.buttons = argument;
+    return hasArgument;
+
+  case BLE_CMD_HID_MOUSE_HOLD:
+    hidMessage.command = HID_MOUSE_HOLD;
+    hidMessage.buttons = argument;
+    return hasArgument;
+
+  case BLE_CMD_HID_MOUSE_RELEASE:
+    hidMessage.command = HID_MOUSE_RELEASE;
+    hidMessage.buttons = argument;
+    return hasArgument;
+
+  case BLE_CMD_HID_MOUSE_SCROLL:
+    hidMessage.command = HID_MOUSE_SCROLL;
+    hidMessage.x = x;
+    hidMessage.y = y;
+    return hasPair;
+
+  case BLE_CMD_HID_GAMEPAD_PRESS:
+  case BLE_CMD_HID_GAMEPAD_HOLD:
+    hidMessage.command = HID_GAMEPAD_BUTTON;
+    hidMessage.key = argument;
+    hidMessage.buttons = 0x80; // Pressed
+    return hasArgument;
+
+  case BLE_CMD_HID_GAMEPAD_RELEASE:
+    hidMessage.command = HID_GAMEPAD_BUTTON;
+    hidMessage.key = argument;
+    hidMessage.buttons = 0x00;
+    return hasArgument;
+
+  case BLE_CMD_HID_GAMEPAD_RIGHT_AXIS:
+    hidMessage.command = HID_GAMEPAD_AXIS_RIGHT;
+    hidMessage.x = x;
+    hidMessage.y = y;
+    return hasPair;
+
+  case BLE_CMD_HID_GAMEPAD_LEFT_AXIS:
+    hidMessage.command = HID_GAMEPAD_AXIS_LEFT;
+    hidMessage.x = x;
+    hidMessage.y = y;
+    return hasPair;
+
+  case BLE_CMD_HID_MOUSE_VELOCITY:
+    hidMessage.command = HID_MOUSE_VELOCITY;
+    hidMessage.x = x;
+    hidMessage.y = y;
+    hidMessage.duration = message.dataCount >= 4 ? (uint16_t)atoi(message.parsedData[3]) : USB_MOTION_DEFAULT_TIMEOUT_MS;
+    return hasPair;
+
+  case BLE_CMD_HID_GAMEPAD_AXIS_TARGET:
+    hidMessage.command = HID_GAMEPAD_AXIS_TARGET;
+    hidMessage.key = argument;
+    hidMessage.x = message.dataCount >= 4 ? (int16_t)atoi(message.parsedData[2]) : 0;
+    hidMessage.y = message.dataCount >= 4 ? (int16_t)atoi(message.parsedData[3]) : 0;
+    hidMessage.duration = message.dataCount >= 5 ? (uint16_t)atoi(message.parsedData[4]) : 0;
+    return message.dataCount >= 4;
+
+  case BLE_CMD_HID_GAMEPAD_STATE: {
+    if (message.dataCount < 9) {
+      return false;
+    }
+
+    int8_t axes[6];
+    for (uint8_t i = 0; i < 6; i++) {
+      axes[i] = constrain(atoi(message.parsedData[1 + i]), -USB_GAMEPAD_AXIS_MAX, USB_GAMEPAD_AXIS_MAX);
+    }
+
+    // Hat 0 .. 8 only, anything else is a bad command rather than some direction
+    char* end;
+    long hat = strtol(message.parsedData[7], &end, 10);
+    if (end == message.parsedData[7] || *end != '\0' || hat < 0 || hat > 8) {
+      return false;
+    }
+
+    // Decimal, or hex with an explicit 0x; a leading zero is not octal
+    const char* buttonsText = message.parsedData[8];
+    bool hex = buttonsText[0] == '0' && (buttonsText[1] == 'x' || buttonsText[1] == 'X');
+    const char* digits = hex ? buttonsText + 2 : buttonsText;
+    unsigned long buttons = strtoul(digits, &end, hex ? 16 : 10);
+    if (!isxdigit((unsigned char)digits[0]) || end == digits || *end != '\0' || buttons > 0xFFFFFFFFUL) {
+      return false;
+    }
+
+    HIDGamepadReport report = { axes[0], axes[1], axes[2], axes[3], axes[4], axes[5], (uint8_t)hat, (uint32_t)buttons };
+
+    hidMessage.command = HID_GAMEPAD_REPORT;
+    memcpy(hidMessage.report, &report, sizeof(report));
+    return true;
+  }
+
+  case BLE_CMD_HID_POINTER_MOVE: {
+    // Signed parse and clamp here, a negative coordinate would otherwise wrap to the far edge
+    long x = hasPair ? strtol(message.parsedData[1], NULL, 10) : 0;
+    long y = hasPair ? strtol(message.parsedData[2], NULL, 10) : 0;
+    hidMessage.command = HID_POINTER_MOVE;
+    hidMessage.x = constrain(x, 0L, (long)usbManager->getPointerSurfaceWidth() - 1);
+    hidMessage.y = constrain(y, 0L, (long)usbManager->getPointerSurfaceHeight() - 1);
+    hidMessage.buttons = message.dataCount >= 4 ? (uint8_t)atoi(message.parsedData[3]) : 0;
+    return hasPair;
+  }
+
+  case BLE_CMD_HID_SYSTEM_POWER:
+    hidMessage.command = HID_SYSTEM_POWER;
+    return true;
+
+  default:
     return false;
   }
+}
+
+bool BLEManager::isBatch(const char* data) const {
+  // A trailing line break is just a terminator, a batch has content after it
+  const char* separator = strchr(data, BLE_CMD_BATCH_SEPARATOR);
+  while (separator) {
+    for (const char* c = separator + 1; *c && *c != BLE_CMD_BATCH_SEPARATOR; c++) {
+      if (*c != '\r' && *c != ' ') {
+        return true;
+      }
+    }
+    separator = strchr(separator + 1, BLE_CMD_BATCH_SEPARATOR);
+  }
+  return false;
+}
+
+void BLEManager::handleBatch(const BLEMessage& message) {
+  char buffer[BLE_CMD_MAX_LENGTH];
+  strncpy(buffer, message.rawData, sizeof(buffer) - 1);
+  buffer[sizeof(buffer) - 1] = '\0';
+
+  HIDMessage hidMessages[BLE_CMD_MAX_BATCH];
+  size_t count = 0;
+  BLEMessage line;
+
+  char* cursor = buffer;
+  while (cursor) {
+    char* end = strchr(cursor, BLE_CMD_BATCH_SEPARATOR);
+    if (end) {
+      *end = '\0';
+    }
 
-  BLEDescriptor* pDescriptor = pTxCharacteristic->getDescriptorByUUID(BLEUUID((uint16_t)0x2902));
-  if (pDescriptor) {
-    uint8_t* descriptorData = pDescriptor->getValue();
-    size_t descriptorLength = pDescriptor->getLength();
-    if (descriptorLength > 0) {
-      DEBUG_PRINTF("Client notification descriptor: 0x%02X\n", descriptorData[0]);
-      if (descriptorData[0] == 0x01) {
-        DEBUG_PRINTLN("Notifications are ENABLED");
+    while (*cursor == ' ' || *cursor == '\r') {
+      cursor++;
+    }
+
+    if (*cursor != '\0') {
+      if (count >= BLE_CMD_MAX_BATCH) {
+        DEBUG_PRINTF("ERROR: Batch has more than %d commands\n", BLE_CMD_MAX_BATCH);
+        sendResponse(message.connHandle, BLE_CMD_WAS_FAILURE);
+        return;
+      }
+
+      parseCommand(cursor, line);
+      // Only HID commands can be batched, anything else fails the whole batch before it runs
+      if (!buildHIDMessage(line, hidMessages[count])) {
+        DEBUG_PRINTF("ERROR: Batch line %d is not a valid HID command: '%s'\n", count + 1, cursor);
+        sendResponse(message.connHandle, BLE_CMD_WAS_FAILURE);
+        return;
       }
-      else {
-        DEBUG_PRINTLN("WARNING: Notifications are NOT enabled by client");
+      // line is reused for the next command, point typed text at the same bytes in buffer instead
+      if (hidMessages[count].command == HID_KEYBOARD_TYPE) {
+        hidMessages[count].text = cursor + (hidMessages[count].text - line.rawData);
       }
+      count++;
     }
-    else {
-      DEBUG_PRINTLN("WARNING: No notification descriptor value found - client may not have enabled notifications");
+
+    cursor = end ? end + 1 : nullptr;
+  }
+
+  if (count == 0) {
+    sendResponse(message.connHandle, BLE_CMD_WAS_FAILURE);
+    return;
+  }
+
+  notifyHIDActivity(message.connHandle);
+
+  // The space check happens under the queue mutex, so the whole batch is either queued or rejected as busy
+  HIDQueueResult result = usbManager->queueHIDMessages(hidMessages, count);
+  if (result == HID_QUEUE_BUSY) {
+    DEBUG_PRINTF("HID queue can not take a batch of %d, rejected as busy\n", count);
+    sendResponse(message.connHandle, BLE_CMD_WAS_BUSY);
+    return;
+  }
+
+  DEBUG_PRINTF("HID batch of %d commands: %s\n", count, result == HID_QUEUE_OK ? "queued" : "FAILED");
+  sendResponse(message.connHandle, result == HID_QUEUE_OK ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
+}
+
+void BLEManager::notifyHIDActivity(uint16_t connHandle) {
+  if (!xSemaphoreTake(clientMutex, pdMS_TO_TICKS(100))) {
+    return;
+  }
+
+  BLEClient* client = findClient(connHandle);
+  if (client) {
+    client->lastHIDActivityTime = millis();
+    if (client->profile != BLE_CONN_PROFILE_FAST) {
+      requestConnectionProfile(*client, BLE_CONN_PROFILE_FAST);
+    }
+  }
+
+  xSemaphoreGive(clientMutex);
+}
+
+void BLEManager::updateConnectionProfiles() {
+  if (connectedCount == 0 || !xSemaphoreTake(clientMutex, pdMS_TO_TICKS(100))) {
+    return;
+  }
+
+  // Each link is tuned on its own, a telemetry-only phone can idle while a controller streams input
+  uint32_t now = millis();
+  for (BLEClient& client : clients) {
+    if (!client.active) {
+      continue;
+    }
+
+    bool hidActive = (now - client.lastHIDActivityTime) < BLE_CONN_IDLE_AFTER_MS;
+    BLEConnectionProfile wanted = hidActive ? BLE_CONN_PROFILE_FAST : BLE_CONN_PROFILE_IDLE;
+
+    if (wanted != client.profile) {
+      requestConnectionProfile(client, wanted);
+    }
+  }
+
+  xSemaphoreGive(clientMutex);
+}
+
+void BLEManager::requestConnectionProfile(BLEClient& client, BLEConnectionProfile profile) {
+  if (!client.active || !pServer) {
+    return;
+  }
+
+  // A refused request is retried by updateConnectionProfiles, but not on every input packet
+  uint32_t now = millis();
+  if (client.profileRetryPending && (now - client.profileRequestTime) < BLE_CONN_PROFILE_RETRY_MS) {
+    return;
+  }
+
+  bool requested = false;
+  switch (profile) {
+  case BLE_CONN_PROFILE_FAST:
+    DEBUG_PRINTF("Requesting fast BLE connection parameters for connection %d\n", client.connHandle);
+    requested = pServer->updateConnParams(client.connHandle, BLE_CONN_FAST_MIN_INTERVAL, BLE_CONN_FAST_MAX_INTERVAL,
+      BLE_CONN_FAST_LATENCY, BLE_CONN_FAST_TIMEOUT);
+    break;
+
+  case BLE_CONN_PROFILE_IDLE:
+    DEBUG_PRINTF("Requesting idle BLE connection parameters for connection %d\n", client.connHandle);
+    requested = pServer->updateConnParams(client.connHandle, BLE_CONN_IDLE_MIN_INTERVAL, BLE_CONN_IDLE_MAX_INTERVAL,
+      BLE_CONN_IDLE_LATENCY, BLE_CONN_IDLE_TIMEOUT);
+    break;
+
+  default:
+    return;
+  }
+
+  client.profileRequestTime = now;
+  client.profileRetryPending = !requested;
+  if (!requested) {
+    DEBUG_PRINTF("ERROR: Connection parameter request failed for connection %d\n", client.connHandle);
+    return;
+  }
+
+  client.profile = profile;
+}
+
+const char* BLEManager::getBLEInfo(uint16_t connHandle) {
+  static char info[160];
+
+  BLEClient client = {};
+  if (xSemaphoreTake(clientMutex, pdMS_TO_TICKS(100))) {
+    BLEClient* found = findClient(connHandle);
+    if (found) {
+      client = *found;
+    }
+    xSemaphoreGive(clientMutex);
+  }
+
+  const char* profileName = "NONE";
+  if (client.profile == BLE_CONN_PROFILE_FAST) profileName = "FAST";
+  else if (client.profile == BLE_CONN_PROFILE_IDLE) profileName = "IDLE";
+
+  auto phyName = [](uint8_t phy) {
+    switch (phy) {
+    case BLE_GAP_LE_PHY_1M: return "1M";
+    case BLE_GAP_LE_PHY_2M: return "2M";
+    case BLE_GAP_LE_PHY_CODED: return "CODED";
+    default: return "NONE";
+    }
+  };
+
+  const char* reconnectPath = "NONE";
+  if (wakeToConnectMs > 0) {
+    if (wakeConnectPhase == BLE_RECONNECT_DIRECTED) reconnectPath = "DIRECTED";
+    else if (wakeConnectPhase == BLE_RECONNECT_WHITELIST) reconnectPath = "WHITELIST";
+    else reconnectPath = "UNDIRECTED";
+  }
+
+  snprintf(info, sizeof(info), "BLE_INFO:%u|%.2f|%u|%u|%s|%lu|%lu|%lu|%lu|%u|%s|%s|%u|%.1f|%lu|%s",
+    client.mtu,
+    client.interval * 1.25f,
+    client.latency,
+    client.timeout * 10,
+    profileName,
+    client.paramUpdates,
+    initDurationMs,
+    initHeapUsage,
+    client.connectLatencyMs,
+    connectedCount,
+    phyName(client.txPhy),
+    phyName(client.rxPhy),
+    client.dataLen,
+    advertisingInterval * 0.625f,
+    wakeToConnectMs,
+    reconnectPath);
+
+  return info;
+}
+
+bool BLEManager::setTelemetrySubscription(uint16_t connHandle, uint8_t fields, uint32_t periodMs, uint16_t voltageThresholdMv, uint16_t currentThresholdMa, uint8_t percentageThreshold) {
+  if (!xSemaphoreTake(clientMutex, pdMS_TO_TICKS(100))) {
+    DEBUG_PRINTLN("ERROR: Failed to acquire BLE client mutex for telemetry subscription");
+    return false;
+  }
+
+  BLEClient* client = findClient(connHandle);
+  if (!client) {
+    xSemaphoreGive(clientMutex);
+    return false;
+  }
+
+  TelemetrySubscription& subscription = client->telemetry;
+  subscription = {};
+  subscription.active = fields != 0;
+  subscription.fields = fields;
+  subscription.periodMs = periodMs < BLE_TELEMETRY_MIN_PERIOD_MS ? BLE_TELEMETRY_MIN_PERIOD_MS : periodMs;
+  subscription.voltageThresholdMv = voltageThresholdMv;
+  subscription.currentThresholdMa = currentThresholdMa;
+  subscription.percentageThreshold = percentageThreshold;
+  subscription.hasSent = false;
+
+  DEBUG_PRINTF("Telemetry subscription for connection %d: fields=0x%02X, period=%lums, thresholds=%umV/%umA/%u%%\n",
+    connHandle, fields, subscription.periodMs, voltageThresholdMv, currentThresholdMa, percentageThreshold);
+
+  xSemaphoreGive(clientMutex);
+  return true;
+}
+
+void BLEManager::clearTelemetrySubscription(uint16_t connHandle) {
+  if (!xSemaphoreTake(clientMutex, pdMS_TO_TICKS(100))) {
+    return;
+  }
+
+  BLEClient* client = findClient(connHandle);
+  if (client) {
+    client->telemetry = {};
+    DEBUG_PRINTF("Telemetry subscription for connection %d cleared\n", connHandle);
+  }
+
+  xSemaphoreGive(clientMutex);
+}
+
+bool BLEManager::sendResponse(uint16_t connHandle, const char* response) {
+  if (!pTxCharacteristic) {
+    DEBUG_PRINTLN("ERROR: Cannot send BLE response - no TX characteristic");
+    return false;
+  }
+
+  uint16_t mtu = 0;
+  if (xSemaphoreTake(clientMutex, pdMS_TO_TICKS(100))) {
+    BLEClient* client = findClient(connHandle);
+    if (client) {
+      mtu = client->mtu;
+    }
+    xSemaphoreGive(clientMutex);
+  }
+
+  if (mtu == 0) {
+    DEBUG_PRINTF("ERROR: Cannot send BLE response - connection %d is gone\n", connHandle);
+    return false;
+  }
+  DEBUG_PRINTF("Negotiated BLE MTU: %d bytes\n", mtu);
+
+  // Calculate usable payload size (MTU - ATT overhead)
+  // ATT Write/Notification overhead is typically 3 bytes
+  size_t maxPayloadSize = (mtu > 3) ? (mtu - 3) : 20;
+
+  const size_t MAX_BLE_PACKET_SIZE = (maxPayloadSize > 160) ? 160 : maxPayloadSize;
+
+  size_t responseLen = strlen(response);
+  DEBUG_PRINTF("Sending BLE response (%d bytes), Max packet size: %d bytes\n", responseLen, MAX_BLE_PACKET_SIZE);
+  DEBUG_PRINTF("Response content: '%s'\n", response);
+
+  if (!xSemaphoreTake(bleMutex, pdMS_TO_TICKS(100))) {
+    DEBUG_PRINTLN("ERROR: Failed to acquire BLE mutex for response");
+    return false;
+  }
+
+  if (responseLen <= MAX_BLE_PACKET_SIZE) {
+    pTxCharacteristic->notify(reinterpret_cast<const uint8_t*>(response), responseLen, connHandle);
+    DEBUG_PRINTLN("BLE response sent successfully (single packet)");
+  }
+  else {
+    size_t offset = 0;
+    int packetNum = 1;
+
+    while (offset < responseLen) {
+      size_t remainingBytes = responseLen - offset;
+      size_t chunkSize = (remainingBytes > MAX_BLE_PACKET_SIZE) ? MAX_BLE_PACKET_SIZE : remainingBytes;
+
+      char packet[MAX_BLE_PACKET_SIZE + 1];
+      strncpy(packet, response + offset, chunkSize);
+      packet[chunkSize] = '\0';
+
+      DEBUG_PRINTF("Sending BLE packet %d (%d bytes): '%s'\n", packetNum, strlen(packet), packet);
+
+      pTxCharacteristic->notify(reinterpret_cast<const uint8_t*>(packet), chunkSize, connHandle);
+
+      offset += chunkSize;
+      packetNum++;
+
+      // NOTE: Will this cause issues with UX?
+      delay(10);
+    }
+
+    DEBUG_PRINTF("BLE response sent successfully (%d packets)\n", packetNum - 1);
+  }
+
+  xSemaphoreGive(bleMutex);
+  return true;
+}
+
+void BLEManager::publishTelemetry(const PowerTelemetrySample& sample) {
+  if (!pTelemetryCharacteristic || !xSemaphoreTake(clientMutex, pdMS_TO_TICKS(100))) {
+    return;
+  }
+
+  // Packets are built under clientMutex and sent after it is released, bleMutex can be held for a long response
+  struct {
+    uint16_t connHandle;
+    uint8_t packet[BLE_TELEMETRY_MAX_PACKET_SIZE];
+    size_t length;
+  } updates[BLE_MAX_CONNECTIONS];
+  uint8_t updateCount = 0;
+
+  uint32_t now = millis();
+  for (BLEClient& client : clients) {
+    if (!client.active || !PowerManager::isTelemetryDue(client.telemetry, sample, now)) {
+      continue;
+    }
+
+    auto& update = updates[updateCount];
+    update.length = PowerManager::packTelemetry(client.telemetry.fields, sample, update.packet, sizeof(update.packet));
+    if (update.length > 0) {
+      update.connHandle = client.connHandle;
+      updateCount++;
+    }
+  }
+
+  xSemaphoreGive(clientMutex);
+
+  for (uint8_t i = 0; i < updateCount; i++) {
+    if (!xSemaphoreTake(bleMutex, pdMS_TO_TICKS(100))) {
+      continue;
+    }
+    bool sent = pTelemetryCharacteristic->notify(updates[i].packet, updates[i].length, updates[i].connHandle);
+    xSemaphoreGive(bleMutex);
+
+    // The client may have gone meanwhile, findClient then simply misses
+    if (sent && xSemaphoreTake(clientMutex, pdMS_TO_TICKS(100))) {
+      BLEClient* client = findClient(updates[i].connHandle);
+      if (client) {
+        client->telemetry.hasSent = true;
+        client->telemetry.lastSentTime = now;
+        client->telemetry.lastSent = sample;
+      }
+      xSemaphoreGive(clientMutex);
+      DEBUG_VERBOSE_PRINTF("Telemetry update sent to connection %d (%d bytes)\n", updates[i].connHandle, updates[i].length);
     }
   }
+}
+
+bool BLEManager::syncClientClock(uint16_t connHandle, uint32_t clientTime) {
+  if (!xSemaphoreTake(clientMutex, pdMS_TO_TICKS(100))) {
+    return false;
+  }
+
+  BLEClient* client = findClient(connHandle);
+  if (!client) {
+    xSemaphoreGive(clientMutex);
+    return false;
+  }
+
+  // Each sample is the true offset plus the one-way delay, so keep the smallest one and only creep
+  // upward slowly to follow clock drift
+  int32_t sample = (int32_t)(millis() - clientTime);
+  if (!client->clockSynced || sample < client->clockOffset) {
+    client->clockOffset = sample;
+  }
   else {
-    DEBUG_PRINTLN("WARNING: No notification descriptor found");
+    client->clockOffset += (sample - client->clockOffset) / 16;
+  }
+  client->clockSynced = true;
+
+  xSemaphoreGive(clientMutex);
+  return true;
+}
+
+uint32_t BLEManager::toDeviceTime(const BLEClient& client, uint16_t clientTime) const {
+  uint32_t now = millis();
+  if (!client.clockSynced) {
+    return now;
+  }
+
+  // Expand the 16 bit client time around the client's current time, then map it onto millis()
+  uint32_t clientNow = now - client.clockOffset;
+  uint32_t fullClientTime = clientNow + (int16_t)(clientTime - (uint16_t)clientNow);
+  uint32_t deviceTime = fullClientTime + client.clockOffset;
+
+  // An event can not have happened in the future, that only means the offset estimate is off
+  return (int32_t)(deviceTime - now) > 0 ? now : deviceTime;
+}
+
+int BLEManager::getInputRecordLength(uint8_t type) {
+  switch (type & ~BLE_INPUT_FLAG_TIMESTAMP) {
+  case BLE_INPUT_SYSTEM_POWER:
+    return 0;
+  case BLE_INPUT_KEYBOARD_PRESS:
+  case BLE_INPUT_KEYBOARD_HOLD:
+  case BLE_INPUT_KEYBOARD_RELEASE:
+  case BLE_INPUT_MOUSE_PRESS:
+  case BLE_INPUT_MOUSE_HOLD:
+  case BLE_INPUT_MOUSE_RELEASE:
+  case BLE_INPUT_GAMEPAD_PRESS:
+  case BLE_INPUT_GAMEPAD_HOLD:
+  case BLE_INPUT_GAMEPAD_RELEASE:
+    return 1;
+  case BLE_INPUT_MOUSE_MOVE:
+  case BLE_INPUT_MOUSE_SCROLL:
+  case BLE_INPUT_GAMEPAD_LEFT_AXIS:
+  case BLE_INPUT_GAMEPAD_RIGHT_AXIS:
+    return 4;
+  case BLE_INPUT_MOUSE_VELOCITY:
+    return 6;
+  case BLE_INPUT_POINTER_MOVE:
+    return 5;
+  case BLE_INPUT_GAMEPAD_AXIS_TARGET:
+    return 7;
+  case BLE_INPUT_KEYBOARD_REPORT:
+    return sizeof(KeyReport);
+  case BLE_INPUT_MOUSE_REPORT:
+    return sizeof(HIDMouseReport);
+  case BLE_INPUT_GAMEPAD_REPORT:
+    return sizeof(HIDGamepadReport);
+  default:
+    return -1;
+  }
+}
+
+void BLEManager::handleInputPacket(BLEClient& client, const uint8_t* data, size_t length) {
+  BLEInputAck& ack = client.inputAck;
+  client.inputAckPending = true;
+
+  if (length < sizeof(uint16_t)) {
+    ack.rejected++;
+    return;
+  }
+
+  uint16_t seq;
+  memcpy(&seq, data, sizeof(seq));
+
+  // A sequence number behind the last one means the client restarted its stream
+  uint16_t gap = seq - (uint16_t)(ack.lastSeq + 1);
+  if (client.inputStarted && gap < 0x8000) {
+    ack.lost += gap;
+  }
+  client.inputStarted = true;
+  ack.lastSeq = seq;
+  ack.received++;
+  client.lastHIDActivityTime = millis();
+
+  size_t offset = sizeof(seq);
+  while (offset < length) {
+    uint8_t type = data[offset++];
+    int payloadLength = getInputRecordLength(type);
+    size_t timeLength = (type & BLE_INPUT_FLAG_TIMESTAMP) ? sizeof(uint16_t) : 0;
+    if (payloadLength < 0 || offset + timeLength + payloadLength > length) {
+      DEBUG_PRINTF("ERROR: Bad input record 0x%02X in packet %u\n", type, seq);
+      ack.rejected++;
+      return;
+    }
+
+    uint32_t timestamp = millis();
+    if (timeLength) {
+      uint16_t clientTime;
+      memcpy(&clientTime, data + offset, sizeof(clientTime));
+      timestamp = toDeviceTime(client, clientTime);
+      offset += timeLength;
+    }
+
+    // Records beyond the granted credits are refused, the client has to wait for the next ack
+    client.inputRecords++;
+    if ((int32_t)(client.inputRecords - ack.creditLimit) > 0) {
+      ack.overrun++;
+    }
+    else if (!dispatchInputRecord(type & ~BLE_INPUT_FLAG_TIMESTAMP, data + offset, timestamp)) {
+      ack.dropped++;
+    }
+    offset += payloadLength;
+  }
+}
+
+bool BLEManager::dispatchInputRecord(uint8_t type, const uint8_t* payload, uint32_t timestamp) {
+  HIDMessage message = {};
+  message.timestamp = timestamp;
+  int payloadLength = getInputRecordLength(type);
+
+  // Whole reports go through as they are
+  if (type == BLE_INPUT_KEYBOARD_REPORT || type == BLE_INPUT_MOUSE_REPORT || type == BLE_INPUT_GAMEPAD_REPORT) {
+    message.command = type == BLE_INPUT_KEYBOARD_REPORT ? HID_KEYBOARD_REPORT :
+      type == BLE_INPUT_MOUSE_REPORT ? HID_MOUSE_REPORT : HID_GAMEPAD_REPORT;
+    memcpy(message.report, payload, payloadLength);
+    return usbManager->queueHIDMessages(&message, 1) == HID_QUEUE_OK;
+  }
+
+  // Axis and pointer records share the X, Y prefix, the longer ones append their duration and stick
+  if (payloadLength >= 4) {
+    memcpy(&message.x, payload, sizeof(message.x));
+    memcpy(&message.y, payload + sizeof(message.x), sizeof(message.y));
+  }
+  if (payloadLength >= 6) {
+    memcpy(&message.duration, payload + 4, sizeof(message.duration));
+  }
+
+  switch (type) {
+  case BLE_INPUT_KEYBOARD_PRESS: message.command = HID_KEYBOARD_PRESS; message.key = payload[0]; break;
+  case BLE_INPUT_KEYBOARD_HOLD: message.command = HID_KEYBOARD_HOLD; message.key = payload[0]; break;
+  case BLE_INPUT_KEYBOARD_RELEASE: message.command = HID_KEYBOARD_RELEASE; message.key = payload[0]; break;
+  case BLE_INPUT_MOUSE_MOVE: message.command = HID_MOUSE_MOVE; break;
+  case BLE_INPUT_MOUSE_PRESS: message.command = HID_MOUSE_PRESS; message.buttons = payload[0]; break;
+  case BLE_INPUT_MOUSE_HOLD: message.command = HID_MOUSE_HOLD; message.buttons = payload[0]; break;
+  case BLE_INPUT_MOUSE_RELEASE: message.command = HID_MOUSE_RELEASE; message.buttons = payload[0]; break;
+  case BLE_INPUT_MOUSE_SCROLL: message.command = HID_MOUSE_SCROLL; break;
+  case BLE_INPUT_GAMEPAD_PRESS:
+  case BLE_INPUT_GAMEPAD_HOLD: message.command = HID_GAMEPAD_BUTTON; message.key = payload[0]; message.buttons = 0x80; break;
+  case BLE_INPUT_GAMEPAD_RELEASE: message.command = HID_GAMEPAD_BUTTON; message.key = payload[0]; break;
+  case BLE_INPUT_GAMEPAD_LEFT_AXIS: message.command = HID_GAMEPAD_AXIS_LEFT; break;
+  case BLE_INPUT_GAMEPAD_RIGHT_AXIS: message.command = HID_GAMEPAD_AXIS_RIGHT; break;
+  case BLE_INPUT_MOUSE_VELOCITY: message.command = HID_MOUSE_VELOCITY; break;
+  case BLE_INPUT_GAMEPAD_AXIS_TARGET: message.command = HID_GAMEPAD_AXIS_TARGET; message.key = payload[6]; break;
+  case BLE_INPUT_SYSTEM_POWER: message.command = HID_SYSTEM_POWER; break;
+  case BLE_INPUT_POINTER_MOVE: message.command = HID_POINTER_MOVE; message.buttons = payload[4]; break;
+  default: return false;
+  }
+
+  return usbManager->queueHIDMessages(&message, 1) == HID_QUEUE_OK;
+}
+
+void BLEManager::grantInputCredits() {
+  // Caller holds clientMutex
+  uint32_t outstanding = 0;
+  uint8_t streamingClients = 0;
+  for (BLEClient& client : clients) {
+    if (client.active && client.inputSubscribed) {
+      streamingClients++;
+      int32_t unused = (int32_t)(client.inputAck.creditLimit - client.inputRecords);
+      outstanding += unused > 0 ? unused : 0;
+    }
+  }
+
+  if (streamingClients == 0) {
+    return;
+  }
+
+  // Never promise more than the queue can hold right now, split it evenly between streaming clients
+  uint32_t space = usbManager->getHIDQueueSpace();
+  uint32_t spare = space > outstanding ? space - outstanding : 0;
+  uint32_t window = usbManager->getHIDQueueCapacity() / streamingClients;
+
+  for (BLEClient& client : clients) {
+    if (spare == 0) {
+      break;
+    }
+    if (!client.active || !client.inputSubscribed) {
+      continue;
+    }
+
+    int32_t unused = (int32_t)(client.inputAck.creditLimit - client.inputRecords);
+    uint32_t held = unused > 0 ? unused : 0;
+    if (held >= window) {
+      continue;
+    }
+
+    uint32_t grant = window - held < spare ? window - held : spare;
+    // Credits start from the records already seen, overruns are not paid back
+    if (unused < 0) {
+      client.inputAck.creditLimit = client.inputRecords;
+    }
+    client.inputAck.creditLimit += grant;
+    spare -= grant;
+    client.inputAckPending = true;
+  }
+}
+
+void BLEManager::sendInputAcks() {
+  if (!pInputCharacteristic || connectedCount == 0 || !xSemaphoreTake(clientMutex, pdMS_TO_TICKS(100))) {
+    return;
+  }
+
+  grantInputCredits();
+
+  // Acks are copied under clientMutex and sent after it is released, bleMutex can be held for a long response
+  struct {
+    uint16_t connHandle;
+    BLEInputAck ack;
+  } acks[BLE_MAX_CONNECTIONS];
+  uint8_t ackCount = 0;
+
+  uint32_t now = millis();
+  for (BLEClient& client : clients) {
+    if (!client.active || !client.inputAckPending) {
+      continue;
+    }
+
+    // Fresh credits go out at once so a fast client never idles, plain counters wait for the interval
+    bool creditsReady = client.inputAck.creditLimit - client.inputCreditsAtLastAck >= BLE_INPUT_CREDIT_BATCH;
+    if (!creditsReady && (now - client.lastInputAckTime) < BLE_INPUT_ACK_INTERVAL_MS) {
+      continue;
+    }
+
+    acks[ackCount].connHandle = client.connHandle;
+    acks[ackCount].ack = client.inputAck;
+    ackCount++;
+
+    // Marked as sent up front; if the notify fails the next ack carries the same cumulative counters
+    client.inputAckPending = false;
+    client.lastInputAckTime = now;
+    client.inputCreditsAtLastAck = client.inputAck.creditLimit;
+  }
+
+  xSemaphoreGive(clientMutex);
+
+  for (uint8_t i = 0; i < ackCount; i++) {
+    if (!xSemaphoreTake(bleMutex, pdMS_TO_TICKS(100))) {
+      continue;
+    }
+    pInputCharacteristic->notify(reinterpret_cast<const uint8_t*>(&acks[i].ack), sizeof(acks[i].ack), acks[i].connHandle);
+    xSemaphoreGive(bleMutex);
   }
+}
 
-  uint16_t mtu = 23; // Default BLE MTU
-  if (deviceConnected && pServer) {
-    mtu = pServer->getPeerMTU(pServer->getConnId());
-    DEBUG_PRINTF("Negotiated BLE MTU: %d bytes\n", mtu);
+void BLEManager::updatePowerStatus(const PowerTelemetrySample& sample) {
+  if (!pPowerStatusCharacteristic || !pBatteryLevelCharacteristic) {
+    return;
+  }
+
+  uint8_t packet[BLE_TELEMETRY_MAX_PACKET_SIZE];
+  size_t length = PowerManager::packTelemetry(TELEMETRY_FIELDS_ALL, sample, packet, sizeof(packet));
+  if (length == 0) {
+    return;
   }
 
-  // Calculate usable payload size (MTU - ATT overhead)
-  // ATT Write/Notification overhead is typically 3 bytes
-  size_t maxPayloadSize = (mtu > 3) ? (mtu - 3) : 20;
-
-  const size_t MAX_BLE_PACKET_SIZE = (maxPayloadSize > 160) ? 160 : maxPayloadSize;
+  uint8_t batteryLevel = sample.batteryPercentage > 100 ? 100 : sample.batteryPercentage;
 
-  size_t responseLen = strlen(response);
-  DEBUG_PRINTF("Sending BLE response (%d bytes), Max packet size: %d bytes\n", responseLen, MAX_BLE_PACKET_SIZE);
-  DEBUG_PRINTF("Response content: '%s'\n", response);
+  if (!xSemaphoreTake(bleMutex, pdMS_TO_TICKS(100))) {
+    DEBUG_PRINTLN("ERROR: Failed to acquire BLE mutex for power status");
+    return;
+  }
 
-  if (responseLen <= MAX_BLE_PACKET_SIZE) {
-    pTxCharacteristic->setValue(response);
-    pTxCharacteristic->notify();
-    DEBUG_PRINTLN("BLE response sent successfully (single packet)");
+  // Values are updated in place, subscribers only hear about actual changes
+  if (length != cachedPowerStatusLength || memcmp(packet, cachedPowerStatus, length) != 0) {
+    memcpy(cachedPowerStatus, packet, length);
+    cachedPowerStatusLength = length;
+    pPowerStatusCharacteristic->setValue(packet, length);
+    if (connectedCount > 0) {
+      pPowerStatusCharacteristic->notify();
+    }
   }
-  else {
-    size_t offset = 0;
-    int packetNum = 1;
 
-    while (offset < responseLen) {
-      size_t remainingBytes = responseLen - offset;
-      size_t chunkSize = (remainingBytes > MAX_BLE_PACKET_SIZE) ? MAX_BLE_PACKET_SIZE : remainingBytes;
+  // Rebuilding the advertisement is left to the BLE task, it retries there until it succeeds
+  pendingAdvBatteryLevel = batteryLevel;
+  pendingAdvState = sample.state;
+  advertisementPending = true;
 
-      char packet[MAX_BLE_PACKET_SIZE + 1];
-      strncpy(packet, response + offset, chunkSize);
-      packet[chunkSize] = '\0';
+  if (batteryLevel != cachedBatteryLevel) {
+    cachedBatteryLevel = batteryLevel;
+    pBatteryLevelCharacteristic->setValue(&batteryLevel, sizeof(batteryLevel));
+    if (connectedCount > 0) {
+      pBatteryLevelCharacteristic->notify();
+    }
+  }
 
-      DEBUG_PRINTF("Sending BLE packet %d (%d bytes): '%s'\n", packetNum, strlen(packet), packet);
+  xSemaphoreGive(bleMutex);
+}
 
-      pTxCharacteristic->setValue(packet);
-      pTxCharacteristic->notify();
+void BLEManager::refreshAdvertisementData() {
+  if (!advertisementPending || !xSemaphoreTake(bleMutex, pdMS_TO_TICKS(10))) {
+    return;
+  }
 
-      offset += chunkSize;
-      packetNum++;
+  uint8_t batteryLevel = pendingAdvBatteryLevel;
+  uint8_t state = pendingAdvState;
+  advertisementPending = false;
 
-      // NOTE: Will this cause issues with UX?
-      delay(10);
+  if (batteryLevel != advertisedBatteryLevel || state != advertisedState) {
+    if (updateAdvertisementData(batteryLevel, state)) {
+      advertisedBatteryLevel = batteryLevel;
+      advertisedState = state;
+    }
+    else {
+      DEBUG_VERBOSE_PRINTLN("Failed to update advertisement telemetry, retrying");
+      advertisementPending = true;
     }
-
-    DEBUG_PRINTF("BLE response sent successfully (%d packets)\n", packetNum - 1);
   }
 
-  return true;
+  xSemaphoreGive(bleMutex);
 }
 
 void BLEManager::processCommands() {
@@ -194,6 +1409,11 @@ void BLEManager::processCommands() {
     DEBUG_PRINTF("=== Processing BLE command from queue ===\n");
     DEBUG_PRINTF("Raw data: '%s'\n", message.rawData);
 
+    if (isBatch(message.rawData)) {
+      handleBatch(message);
+      continue;
+    }
+
     parseCommand(message.rawData, message);
 
     DEBUG_PRINTF("Parsed command: %d\n", message.command);
@@ -203,12 +1423,11 @@ void BLEManager::processCommands() {
 
 void BLEManager::parseCommand(const char* data, BLEMessage& message) {
   DEBUG_PRINTF("BLE parseCommand called with data: '%s'\n", data);
-  // TODO: Add gamepad triggers HID
 
   message.timestamp = millis();
   message.dataCount = 0;
 
-  char cleanData[128];
+  char cleanData[BLE_CMD_MAX_LENGTH];
   strncpy(cleanData, data, sizeof(cleanData) - 1);
   cleanData[sizeof(cleanData) - 1] = '\0';
 
@@ -249,12 +1468,12 @@ void BLEManager::parseCommand(const char* data, BLEMessage& message) {
 }
 
 bool BLEManager::parseDataComponents(const char* data, BLEMessage& message) {
-  for (int i = 0; i < 8; i++) {
+  for (int i = 0; i < BLE_CMD_MAX_PARTS; i++) {
     message.parsedData[i][0] = '\0';
   }
   message.dataCount = 0;
 
-  char buffer[128];
+  char buffer[BLE_CMD_MAX_LENGTH];
   strncpy(buffer, data, sizeof(buffer) - 1);
   buffer[sizeof(buffer) - 1] = '\0';
 
@@ -267,7 +1486,7 @@ bool BLEManager::parseDataComponents(const char* data, BLEMessage& message) {
     char* dataPart = strtok(NULL, "");
     if (dataPart) {
       char* token = strtok(dataPart, BLE_CMD_DATA_SEPARATOR);
-      while (token && message.dataCount < 8) {
+      while (token && message.dataCount < BLE_CMD_MAX_PARTS) {
         strncpy(message.parsedData[message.dataCount], token, sizeof(message.parsedData[message.dataCount]) - 1);
         message.parsedData[message.dataCount][sizeof(message.parsedData[message.dataCount]) - 1] = '\0';
         message.dataCount++;
@@ -291,241 +1510,174 @@ void BLEManager::handleCommand(const BLEMessage& message) {
     DEBUG_PRINTF("  Data[%d]: %s\n", i, message.parsedData[i]);
   }
 
+  if (isHIDCommand(message.command)) {
+    notifyHIDActivity(message.connHandle);
+
+    HIDMessage hidMessage;
+    HIDQueueResult result = buildHIDMessage(message, hidMessage) ? usbManager->queueHIDMessages(&hidMessage, 1) : HID_QUEUE_INVALID;
+
+    // Explicit backpressure instead of a failure the client can not tell apart from a bad command
+    if (result == HID_QUEUE_BUSY) {
+      DEBUG_PRINTF("HID queue full, command %d rejected as busy\n", message.command);
+      sendResponse(message.connHandle, BLE_CMD_WAS_BUSY);
+      return;
+    }
+
+    DEBUG_PRINTF("HID command %d: %s\n", message.command, result == HID_QUEUE_OK ? "queued" : "FAILED");
+    sendResponse(message.connHandle, result == HID_QUEUE_OK ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
+    return;
+  }
+
   switch (message.command) {
   case BLE_CMD_POWER_INFO:
     DEBUG_PRINTLN("Getting power info");
-    sendResponse(powerManager->getPowerInfo());
+    sendResponse(message.connHandle, powerManager->getPowerInfo());
     break;
 
   case BLE_CMD_POWER_ON:
-    powerManager->trySetSBCPower(true);
-    if (statusManager) {
-      statusManager->setStatus(STATUS_POWER_ON, LED_BLINK_DURATION);
-    }
-    sendResponse(BLE_CMD_WAS_SUCCESSFUL);
-    break;
-
   case BLE_CMD_POWER_OFF:
-    powerManager->trySetSBCPower(false);
-    if (statusManager) {
-      statusManager->setStatus(STATUS_POWER_OFF, LED_BLINK_DURATION);
-    }
-    sendResponse(BLE_CMD_WAS_SUCCESSFUL);
-    break;
-
   case BLE_CMD_SHUTDOWN:
-    powerManager->trySetSBCPower(false);
-    if (statusManager) {
-      statusManager->setStatus(STATUS_SHUTDOWN, 0);
+  case BLE_CMD_SYSTEM_RESTART:
+    if (!dispatchJob(message)) {
+      sendResponse(message.connHandle, BLE_CMD_WAS_FAILURE);
     }
-    sendResponse(BLE_CMD_WAS_SUCCESSFUL);
     break;
 
-  case BLE_CMD_HID_KEYBOARD_PRESS:
-    if (message.dataCount >= 2) {
-      uint8_t key = (uint8_t)atoi(message.parsedData[1]);
-      DEBUG_PRINTF("HID Keyboard Press: %d (from string '%s')\n", key, message.parsedData[1]);
-      bool result = usbManager->sendKeyPress(key);
-      DEBUG_PRINTF("sendKeyPress result: %s\n", result ? "SUCCESS" : "FAILURE");
-      sendResponse(result ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
-    }
-    else {
-      DEBUG_PRINTF("HID Keyboard Press: FAILED - insufficient data count: %d\n", message.dataCount);
-      sendResponse(BLE_CMD_WAS_FAILURE);
-    }
-    break;
+  case BLE_CMD_POWER_SUBSCRIBE: {
+    uint8_t fields = message.dataCount >= 2 ? (uint8_t)strtoul(message.parsedData[1], NULL, 0) : TELEMETRY_FIELDS_ALL;
+    uint32_t periodMs = message.dataCount >= 3 ? strtoul(message.parsedData[2], NULL, 0) : BLE_TELEMETRY_DEFAULT_PERIOD_MS;
+    uint16_t voltageThresholdMv = message.dataCount >= 4 ? (uint16_t)atoi(message.parsedData[3]) : 0;
+    uint16_t currentThresholdMa = message.dataCount >= 5 ? (uint16_t)atoi(message.parsedData[4]) : 0;
+    uint8_t percentageThreshold = message.dataCount >= 6 ? (uint8_t)atoi(message.parsedData[5]) : 0;
 
-  case BLE_CMD_HID_KEYBOARD_HOLD:
-    if (message.dataCount >= 2) {
-      uint8_t key = (uint8_t)atoi(message.parsedData[1]);
-      DEBUG_PRINTF("HID Keyboard Hold: %d\n", key);
-      sendResponse(usbManager->sendKeyHold(key) ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
-    }
-    else {
-      sendResponse(BLE_CMD_WAS_FAILURE);
+    if (fields == 0) {
+      sendResponse(message.connHandle, BLE_CMD_WAS_FAILURE);
+      break;
     }
-    break;
 
-  case BLE_CMD_HID_KEYBOARD_RELEASE:
-    if (message.dataCount >= 2) {
-      uint8_t key = (uint8_t)atoi(message.parsedData[1]);
-      DEBUG_PRINTF("HID Keyboard Release: %d\n", key);
-      sendResponse(usbManager->sendKeyRelease(key) ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
-    }
-    else {
-      sendResponse(BLE_CMD_WAS_FAILURE);
-    }
+    bool subscribed = setTelemetrySubscription(message.connHandle, fields, periodMs, voltageThresholdMv, currentThresholdMa, percentageThreshold);
+    sendResponse(message.connHandle, subscribed ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
     break;
+  }
 
-  case BLE_CMD_HID_KEYBOARD_TYPE:
-    if (message.dataCount >= 2) {
-      DEBUG_PRINTF("HID Keyboard Type: %s\n", message.parsedData[1]);
-      sendResponse(usbManager->typeText(message.parsedData[1]) ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
-    }
-    else {
-      sendResponse(BLE_CMD_WAS_FAILURE);
-    }
+  case BLE_CMD_POWER_UNSUBSCRIBE:
+    DEBUG_PRINTLN("Power telemetry unsubscribe");
+    clearTelemetrySubscription(message.connHandle);
+    sendResponse(message.connHandle, BLE_CMD_WAS_SUCCESSFUL);
     break;
 
-  case BLE_CMD_HID_MOUSE_MOVE:
-    if (message.dataCount >= 3) {
-      int16_t x = (int16_t)atoi(message.parsedData[1]);
-      int16_t y = (int16_t)atoi(message.parsedData[2]);
-      DEBUG_PRINTF("HID Mouse Move: %d, %d\n", x, y);
-      sendResponse(usbManager->sendMouseMove(x, y) ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
-    }
-    else {
-      sendResponse(BLE_CMD_WAS_FAILURE);
-    }
+  case BLE_CMD_HID_TYPING_RATE: {
+    bool result = message.dataCount >= 2 && usbManager->setTypingRate((uint16_t)atoi(message.parsedData[1]));
+    sendResponse(message.connHandle, result ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
     break;
+  }
 
-  case BLE_CMD_HID_MOUSE_PRESS:
-    if (message.dataCount >= 2) {
-      uint8_t button = (uint8_t)atoi(message.parsedData[1]);
-      DEBUG_PRINTF("HID Mouse Press: %d\n", button);
-      sendResponse(usbManager->sendMousePress(button) ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
-    }
-    else {
-      sendResponse(BLE_CMD_WAS_FAILURE);
-    }
+  case BLE_CMD_HID_TYPING_INFO:
+    DEBUG_PRINTLN("Getting typing info");
+    sendResponse(message.connHandle, usbManager->getTypingInfo());
     break;
 
-  case BLE_CMD_HID_MOUSE_HOLD:
-    if (message.dataCount >= 2) {
-      uint8_t button = (uint8_t)atoi(message.parsedData[1]);
-      DEBUG_PRINTF("HID Mouse Hold: %d\n", button);
-      sendResponse(usbManager->sendMouseHold(button) ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
-    }
-    else {
-      sendResponse(BLE_CMD_WAS_FAILURE);
-    }
+  case BLE_CMD_HID_KEYBOARD_NKRO: {
+    bool result = message.dataCount >= 2 && usbManager->setNKROEnabled(atoi(message.parsedData[1]) != 0);
+    sendResponse(message.connHandle, result ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
     break;
+  }
 
-  case BLE_CMD_HID_MOUSE_RELEASE:
-    if (message.dataCount >= 2) {
-      uint8_t button = (uint8_t)atoi(message.parsedData[1]);
-      DEBUG_PRINTF("HID Mouse Release: %d\n", button);
-      sendResponse(usbManager->sendMouseRelease(button) ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
-    }
-    else {
-      sendResponse(BLE_CMD_WAS_FAILURE);
-    }
+  case BLE_CMD_HID_KEYBOARD_LAYOUT: {
+    HIDLayoutId layout;
+    HIDUnicodeMode unicodeMode = HID_UNICODE_NONE;
+    bool result = message.dataCount >= 2 && parseLayoutName(message.parsedData[1], layout) &&
+      (message.dataCount < 3 || parseUnicodeModeName(message.parsedData[2], unicodeMode)) &&
+      usbManager->setKeyboardLayout(layout, unicodeMode);
+    sendResponse(message.connHandle, result ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
     break;
+  }
 
-  case BLE_CMD_HID_MOUSE_SCROLL:
-    if (message.dataCount >= 3) {
-      int8_t scrollX = (int8_t)atoi(message.parsedData[1]);
-      int8_t scrollY = (int8_t)atoi(message.parsedData[2]);
-      DEBUG_PRINTF("HID Mouse Scroll: %d, %d\n", scrollX, scrollY);
-      sendResponse(usbManager->sendMouseScroll(scrollX, scrollY) ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
-    }
-    else {
-      sendResponse(BLE_CMD_WAS_FAILURE);
-    }
+  case BLE_CMD_HID_JITTER: {
+    bool enable = message.dataCount >= 2 && atoi(message.parsedData[1]) != 0;
+    uint32_t delayMs = message.dataCount >= 3 ? strtoul(message.parsedData[2], NULL, 0) : USB_JITTER_DEFAULT_DELAY_MS;
+    bool result = message.dataCount >= 2 && delayMs <= USB_JITTER_MAX_DELAY_MS && usbManager->setJitterBuffer(enable, (uint16_t)delayMs);
+    sendResponse(message.connHandle, result ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
     break;
+  }
 
-  case BLE_CMD_HID_GAMEPAD_PRESS:
-    if (message.dataCount >= 2) {
-      uint8_t button = (uint8_t)atoi(message.parsedData[1]);
-      DEBUG_PRINTF("HID Gamepad Press: %d\n", button);
-      sendResponse(usbManager->sendGamepadButton(button, true) ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
-    }
-    else {
-      sendResponse(BLE_CMD_WAS_FAILURE);
-    }
+  case BLE_CMD_HID_JITTER_INFO:
+    DEBUG_PRINTLN("Getting jitter buffer info");
+    sendResponse(message.connHandle, usbManager->getJitterInfo());
     break;
 
-  case BLE_CMD_HID_GAMEPAD_HOLD:
-    if (message.dataCount >= 2) {
-      uint8_t button = (uint8_t)atoi(message.parsedData[1]);
-      DEBUG_PRINTF("HID Gamepad Hold: %d\n", button);
-      sendResponse(usbManager->sendGamepadButton(button, false) ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
-    }
-    else {
-      sendResponse(BLE_CMD_WAS_FAILURE);
+  case BLE_CMD_CLOCK_SYNC: {
+    if (message.dataCount < 2 || !syncClientClock(message.connHandle, strtoul(message.parsedData[1], NULL, 0))) {
+      sendResponse(message.connHandle, BLE_CMD_WAS_FAILURE);
+      break;
     }
+
+    char response[32];
+    snprintf(response, sizeof(response), "CLOCK_SYNC:%lu", millis());
+    sendResponse(message.connHandle, response);
     break;
+  }
 
-  case BLE_CMD_HID_GAMEPAD_RELEASE:
-    if (message.dataCount >= 2) {
-      uint8_t button = (uint8_t)atoi(message.parsedData[1]);
-      DEBUG_PRINTF("HID Gamepad Release: %d\n", button);
-      sendResponse(usbManager->sendGamepadButton(button, false) ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
-    }
-    else {
-      sendResponse(BLE_CMD_WAS_FAILURE);
-    }
+  case BLE_CMD_HID_POINTER_SURFACE: {
+    bool result = message.dataCount >= 3 &&
+      usbManager->setPointerSurface((uint16_t)atoi(message.parsedData[1]), (uint16_t)atoi(message.parsedData[2]));
+    sendResponse(message.connHandle, result ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
     break;
+  }
 
-  case BLE_CMD_HID_GAMEPAD_RIGHT_AXIS:
-    if (message.dataCount >= 3) {
-      int16_t x = (int16_t)atoi(message.parsedData[1]);
-      int16_t y = (int16_t)atoi(message.parsedData[2]);
-      DEBUG_PRINTF("HID Gamepad Axis: %d, %d\n", x, y);
-      sendResponse(usbManager->sendGamepadRightAxis(x, y) ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
-    }
-    else {
-      sendResponse(BLE_CMD_WAS_FAILURE);
-    }
+  case BLE_CMD_HID_REPORT_INTERVAL: {
+    HIDReportDevice device;
+    bool result = message.dataCount >= 3 && HIDRateMeter::parseDeviceName(message.parsedData[1], device) &&
+      usbManager->setReportInterval(device, (uint16_t)atoi(message.parsedData[2]));
+    sendResponse(message.connHandle, result ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
     break;
+  }
 
-  case BLE_CMD_HID_GAMEPAD_LEFT_AXIS:
-    if (message.dataCount >= 3) {
-      int16_t x = (int16_t)atoi(message.parsedData[1]);
-      int16_t y = (int16_t)atoi(message.parsedData[2]);
-      DEBUG_PRINTF("HID Gamepad Left Axis: %d, %d\n", x, y);
-      sendResponse(usbManager->sendGamepadLeftAxis(x, y) ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
-    }
-    else {
-      sendResponse(BLE_CMD_WAS_FAILURE);
-    }
+  case BLE_CMD_HID_RATE: {
+    bool result = message.dataCount >= 2 && usbManager->setRateMeasurement(atoi(message.parsedData[1]) != 0);
+    sendResponse(message.connHandle, result ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
     break;
+  }
 
-  case BLE_CMD_HID_SYSTEM_POWER:
-    DEBUG_PRINTLN("HID System Power");
-    sendResponse(usbManager->sendSystemPowerKey() ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
+  case BLE_CMD_HID_RATE_INFO:
+    DEBUG_PRINTLN("Getting HID report rates");
+    sendResponse(message.connHandle, usbManager->getRateInfo());
     break;
 
   case BLE_CMD_SYSTEM_INFO:
     DEBUG_PRINTLN("Getting system info");
-    sendResponse(systemManager->getSystemInfo());
-    break;
-
-  case BLE_CMD_SYSTEM_RESTART:
-    DEBUG_PRINTLN("Restarting system");
-    if (statusManager) {
-      statusManager->setStatus(STATUS_SHUTDOWN, LED_BLINK_DURATION);
-    }
-    systemManager->notifyActivity();
-    sendResponse(BLE_CMD_WAS_SUCCESSFUL);
-    delay(1000);
-    esp_restart();
+    sendResponse(message.connHandle, systemManager->getSystemInfo());
     break;
 
   case BLE_CMD_DEEP_SLEEP_INFO: {
     DEBUG_PRINTLN("Getting deep sleep info");
-    sendResponse(systemManager->getDeepSleepInfo());
+    sendResponse(message.connHandle, systemManager->getDeepSleepInfo());
     break;
   }
 
   case BLE_CMD_DEEP_SLEEP_ENABLE:
     DEBUG_PRINTLN("Enabling deep sleep watchdog");
     systemManager->enableDeepSleep();
-    sendResponse(BLE_CMD_WAS_SUCCESSFUL);
+    sendResponse(message.connHandle, BLE_CMD_WAS_SUCCESSFUL);
     break;
 
   case BLE_CMD_DEEP_SLEEP_DISABLE:
     DEBUG_PRINTLN("Disabling deep sleep watchdog");
     systemManager->disableDeepSleep();
-    sendResponse(BLE_CMD_WAS_SUCCESSFUL);
+    sendResponse(message.connHandle, BLE_CMD_WAS_SUCCESSFUL);
+    break;
+
+  case BLE_CMD_BLE_INFO:
+    DEBUG_PRINTLN("Getting BLE info");
+    sendResponse(message.connHandle, getBLEInfo(message.connHandle));
     break;
 
   case BLE_CMD_HELP:
-    sendResponse(BLE_HELP_STRING);
+    sendResponse(message.connHandle, BLE_HELP_STRING);
     break;
 
   default:
-    sendResponse(BLE_CMD_UNKNOWN_STRING);
+    sendResponse(message.connHandle, BLE_CMD_UNKNOWN_STRING);
     if (statusManager) {
       statusManager->setStatus(STATUS_BLE_CMD_ERROR, LED_BLINK_DURATION);
     }
@@ -533,28 +1685,267 @@ void BLEManager::handleCommand(const BLEMessage& message) {
   }
 }
 
-void BLEManager::ServerCallbacks::onConnect(BLEServer* server) {
-  manager->deviceConnected = true;
+bool BLEManager::isLongRunningCommand(BLECommand command) const {
+  switch (command) {
+  case BLE_CMD_POWER_ON:
+  case BLE_CMD_POWER_OFF:
+  case BLE_CMD_SHUTDOWN:
+  case BLE_CMD_SYSTEM_RESTART:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool BLEManager::dispatchJob(const BLEMessage& message) {
+  if (!jobQueue || !isLongRunningCommand(message.command)) {
+    return false;
+  }
+
+  BLEJob job;
+  job.connHandle = message.connHandle;
+  job.requestId = nextRequestId++;
+  job.command = message.command;
+  job.timestamp = millis();
+
+  if (xQueueSend(jobQueue, &job, 0) != pdTRUE) {
+    DEBUG_PRINTF("ERROR: Job queue full, rejecting command %d\n", message.command);
+    return false;
+  }
+
+  DEBUG_PRINTF("Dispatched command %d as request %lu\n", job.command, job.requestId);
+
+  char response[32];
+  snprintf(response, sizeof(response), "%s%s%lu", BLE_CMD_JOB_ACCEPTED, BLE_CMD_PART_SEPARATOR, job.requestId);
+  sendResponse(job.connHandle, response);
+  return true;
+}
+
+void BLEManager::executeJob(const BLEJob& job) {
+  DEBUG_PRINTF("Executing request %lu (command %d), queued for %lu ms\n",
+    job.requestId, job.command, millis() - job.timestamp);
+
+  bool success = false;
+
+  switch (job.command) {
+  case BLE_CMD_POWER_ON:
+    powerManager->trySetSBCPower(true);
+    if (statusManager) {
+      statusManager->setStatus(STATUS_POWER_ON, LED_BLINK_DURATION);
+    }
+    success = powerManager->isSBCPowerOn();
+    break;
+
+  case BLE_CMD_POWER_OFF:
+    powerManager->trySetSBCPower(false);
+    if (statusManager) {
+      statusManager->setStatus(STATUS_POWER_OFF, LED_BLINK_DURATION);
+    }
+    success = !powerManager->isSBCPowerOn();
+    break;
+
+  case BLE_CMD_SHUTDOWN:
+    powerManager->trySetSBCPower(false);
+    if (statusManager) {
+      statusManager->setStatus(STATUS_SHUTDOWN, 0);
+    }
+    success = !powerManager->isSBCPowerOn();
+    break;
+
+  case BLE_CMD_SYSTEM_RESTART:
+    DEBUG_PRINTLN("Restarting system");
+    if (statusManager) {
+      statusManager->setStatus(STATUS_SHUTDOWN, LED_BLINK_DURATION);
+    }
+    systemManager->notifyActivity();
+    success = true;
+    break;
+
+  default:
+    DEBUG_PRINTF("ERROR: Command %d is not an executor job\n", job.command);
+    break;
+  }
+
+  char response[48];
+  snprintf(response, sizeof(response), "%s%s%lu%s%s", BLE_CMD_JOB_DONE, BLE_CMD_PART_SEPARATOR, job.requestId,
+    BLE_CMD_DATA_SEPARATOR, success ? BLE_CMD_WAS_SUCCESSFUL : BLE_CMD_WAS_FAILURE);
+  // The requester may have disconnected meanwhile, sendResponse drops the result then
+  sendResponse(job.connHandle, response);
+
+  if (job.command == BLE_CMD_SYSTEM_RESTART) {
+    delay(1000);
+    esp_restart();
+  }
+}
+
+void BLEManager::executorTask(void* arg) {
+  BLEManager* manager = static_cast<BLEManager*>(arg);
+  BLEJob job;
+
+  // Not registered with the task watchdog, power jobs legitimately block for up to USB_CONNECTION_TIMEOUT twice
+  for (;;) {
+    if (xQueueReceive(manager->jobQueue, &job, portMAX_DELAY) == pdTRUE) {
+      manager->executeJob(job);
+    }
+  }
+}
+
+void BLEManager::ServerCallbacks::onConnect(NimBLEServer* server, NimBLEConnInfo& connInfo) {
+  // clientMutex is only ever held briefly, never across a notify, so the host task can wait for it
+  xSemaphoreTake(manager->clientMutex, portMAX_DELAY);
+
+  BLEClient* client = manager->addClient(connInfo.getConnHandle());
+  if (!client) {
+    xSemaphoreGive(manager->clientMutex);
+    DEBUG_PRINTLN("ERROR: No free BLE client slot, dropping connection");
+    server->disconnect(connInfo.getConnHandle());
+    return;
+  }
+
+  client->mtu = connInfo.getMTU();
+  client->interval = connInfo.getConnInterval();
+  client->latency = connInfo.getConnLatency();
+  client->timeout = connInfo.getConnTimeout();
+  client->profile = BLE_CONN_PROFILE_NONE;
+  client->connectLatencyMs = millis() - manager->advertisingStartTime;
+  // Start tight so service discovery is quick, then relax once the client goes quiet
+  client->lastHIDActivityTime = millis();
+
+  // Every connection starts on 1M, onPhyUpdate reports what was agreed
+  client->txPhy = BLE_GAP_LE_PHY_1M;
+  client->rxPhy = BLE_GAP_LE_PHY_1M;
+  manager->negotiateLink(*client);
+
+  // Boot time is close enough to wake time, setup() runs right after the wake stub
+  if (manager->wokeFromDeepSleep && manager->wakeToConnectMs == 0) {
+    manager->wakeToConnectMs = millis();
+    manager->wakeConnectPhase = manager->reconnectPhase;
+    DEBUG_PRINTF("First BLE connection %lu ms after wake\n", manager->wakeToConnectMs);
+  }
+
+  xSemaphoreGive(manager->clientMutex);
+
+  // Bonded centrals re-encrypt with stored keys right away. Others are only paired once they start HID input,
+  // so a phone that just reads telemetry never gets a pairing prompt.
+  if (NimBLEDevice::isBonded(connInfo.getIdAddress())) {
+    NimBLEDevice::startSecurity(connInfo.getConnHandle());
+  }
+}
+
+void BLEManager::ServerCallbacks::onDisconnect(NimBLEServer* server, NimBLEConnInfo& connInfo, int reason) {
+  DEBUG_PRINTF("BLE connection %d closed (reason: 0x%02X)\n", connInfo.getConnHandle(), reason);
+
+  // Skipping this would leak the slot and leave connectedCount stale
+  xSemaphoreTake(manager->clientMutex, portMAX_DELAY);
+  manager->removeClient(connInfo.getConnHandle());
+  xSemaphoreGive(manager->clientMutex);
+}
+
+void BLEManager::ServerCallbacks::onMTUChange(uint16_t mtu, NimBLEConnInfo& connInfo) {
+  if (xSemaphoreTake(manager->clientMutex, portMAX_DELAY)) {
+    BLEClient* client = manager->findClient(connInfo.getConnHandle());
+    if (client) {
+      client->mtu = mtu;
+    }
+    xSemaphoreGive(manager->clientMutex);
+  }
+}
+
+void BLEManager::ServerCallbacks::onConnParamsUpdate(NimBLEConnInfo& connInfo) {
+  if (xSemaphoreTake(manager->clientMutex, portMAX_DELAY)) {
+    BLEClient* client = manager->findClient(connInfo.getConnHandle());
+    if (client) {
+      client->interval = connInfo.getConnInterval();
+      client->latency = connInfo.getConnLatency();
+      client->timeout = connInfo.getConnTimeout();
+      client->paramUpdates++;
+    }
+    xSemaphoreGive(manager->clientMutex);
+  }
+}
+
+void BLEManager::ServerCallbacks::onPhyUpdate(NimBLEConnInfo& connInfo, uint8_t txPhy, uint8_t rxPhy) {
+  DEBUG_PRINTF("BLE connection %d PHY: TX %d, RX %d\n", connInfo.getConnHandle(), txPhy, rxPhy);
+
+  if (xSemaphoreTake(manager->clientMutex, portMAX_DELAY)) {
+    BLEClient* client = manager->findClient(connInfo.getConnHandle());
+    if (client) {
+      client->txPhy = txPhy;
+      client->rxPhy = rxPhy;
+    }
+    xSemaphoreGive(manager->clientMutex);
+  }
 }
 
-void BLEManager::ServerCallbacks::onDisconnect(BLEServer* server) {
-  manager->deviceConnected = false;
+void BLEManager::ServerCallbacks::onAuthenticationComplete(NimBLEConnInfo& connInfo) {
+  if (!connInfo.isEncrypted()) {
+    DEBUG_PRINTF("BLE connection %d failed to encrypt\n", connInfo.getConnHandle());
+    return;
+  }
+
+  // Identity address, so it still matches after the central rotates its private address
+  if (connInfo.isBonded()) {
+    manager->saveLastPeer(connInfo.getIdAddress());
+  }
 }
 
-void BLEManager::CharacteristicCallbacks::onWrite(BLECharacteristic* characteristic) {
-  std::string stdValue = characteristic->getValue();
-  if (stdValue.length() > 0 && stdValue.length() < 128) {
+void BLEManager::CharacteristicCallbacks::onWrite(NimBLECharacteristic* characteristic, NimBLEConnInfo& connInfo) {
+  NimBLEAttValue value = characteristic->getValue();
+  if (value.length() > 0 && value.length() < BLE_CMD_MAX_LENGTH) {
     if (systemManager) {
       systemManager->notifyActivity();
     }
 
     BLEMessage message; // Will be filled with data later
-    strncpy(message.rawData, stdValue.c_str(), sizeof(message.rawData) - 1);
-    message.rawData[sizeof(message.rawData) - 1] = '\0';
+    message.connHandle = connInfo.getConnHandle();
+    size_t length = value.length() < sizeof(message.rawData) ? value.length() : sizeof(message.rawData) - 1;
+    memcpy(message.rawData, value.data(), length);
+    message.rawData[length] = '\0';
     message.timestamp = millis();
     message.dataCount = 0;
     message.command = BLE_CMD_HELP;
 
-    BaseType_t result = xQueueSendFromISR(manager->commandQueue, &message, NULL);
+    // NimBLE runs callbacks on its host task, not in an ISR
+    xQueueSend(manager->commandQueue, &message, 0);
+  }
+}
+
+void BLEManager::InputCallbacks::onWrite(NimBLECharacteristic* characteristic, NimBLEConnInfo& connInfo) {
+  NimBLEAttValue value = characteristic->getValue();
+  if (value.length() == 0) {
+    return;
+  }
+
+  if (systemManager) {
+    systemManager->notifyActivity();
+  }
+
+  // Records go straight into the HID queue from the host task, nothing waits on the BLE task. clientMutex is
+  // only held briefly, so wait for it: the packet may carry releases the client already spent credit on.
+  xSemaphoreTake(manager->clientMutex, portMAX_DELAY);
+  BLEClient* client = manager->findClient(connInfo.getConnHandle());
+  if (client) {
+    manager->handleInputPacket(*client, value.data(), value.length());
+  }
+  xSemaphoreGive(manager->clientMutex);
+}
+
+void BLEManager::InputCallbacks::onSubscribe(NimBLECharacteristic* characteristic, NimBLEConnInfo& connInfo, uint16_t subValue) {
+  if (!xSemaphoreTake(manager->clientMutex, portMAX_DELAY)) {
+    return;
+  }
+
+  // Credits are only granted to clients that can hear the acks carrying them
+  BLEClient* client = manager->findClient(connInfo.getConnHandle());
+  if (client) {
+    client->inputSubscribed = subValue != 0;
+    client->inputAckPending = client->inputSubscribed;
   }
-}
\ No newline at end of file
+
+  xSemaphoreGive(manager->clientMutex);
+
+  // A central streaming HID input gets bonded, so it can use the fast reconnect after a deep sleep
+  if (subValue != 0 && !connInfo.isEncrypted()) {
+    NimBLEDevice::startSecurity(connInfo.getConnHandle());
+  }
+}
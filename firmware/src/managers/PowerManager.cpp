@@ -6,9 +6,11 @@
 #include <Wire.h>
 #include <semphr.h>
 #include <managers/USBManager.h>
+#include <managers/BLEManager.h>
 
 extern USBManager* usbManager;
 extern StatusManager* statusManager;
+extern BLEManager* bleManager;
 
 PowerManager::PowerManager() {}
 
@@ -82,6 +84,134 @@ void PowerManager::update() {
 
   PowerData currentPowerData = getPowerData();
   DEBUG_PRINTLN(currentPowerData.toString());
+
+  publishTelemetry(currentPowerData);
+}
+
+void PowerManager::publishTelemetry(const PowerData& data) {
+  if (!bleManager) {
+    return;
+  }
+
+  PowerTelemetrySample sample = buildTelemetrySample(data);
+
+  // Keep the readable characteristics current even with nobody connected, so the first read is fresh
+  bleManager->updatePowerStatus(sample);
+
+  if (!bleManager->isConnected()) {
+    return;
+  }
+
+  // Every subscribed client decides on its own whether this sample is worth sending
+  bleManager->publishTelemetry(sample);
+}
+
+PowerTelemetrySample PowerManager::buildTelemetrySample(const PowerData& data) const {
+  PowerTelemetrySample sample = {};
+
+  sample.batteryVoltageMv = static_cast<uint16_t>(data.battery.voltage * 1000);
+  sample.batteryCurrentMa = static_cast<int16_t>(data.battery.current * 1000);
+  sample.batteryPercentage = static_cast<uint8_t>(data.battery.percentage);
+  sample.chargerVoltageMv = static_cast<uint16_t>(data.charger.voltage * 1000);
+  sample.chargerCurrentMa = static_cast<int16_t>(data.charger.current * 1000);
+  sample.toFullyDischargeS = data.battery.toFullyDischargeS;
+  sample.toFullyChargeS = data.charger.toFullyChargeS;
+
+  sample.state = 0;
+  if (data.charger.connected) sample.state |= TELEMETRY_STATE_CHARGING;
+  if (isSBCPowerOn()) sample.state |= TELEMETRY_STATE_SBC_POWERED;
+  if (data.powerSavingMode) sample.state |= TELEMETRY_STATE_POWER_SAVING;
+
+  return sample;
+}
+
+bool PowerManager::isTimeEstimateChanged(uint32_t seconds, uint32_t lastSeconds) {
+  // The estimates follow the current and wobble every sample, only an estimate appearing or vanishing counts right away
+  if ((seconds == 0) != (lastSeconds == 0)) {
+    return true;
+  }
+
+  uint32_t difference = seconds > lastSeconds ? seconds - lastSeconds : lastSeconds - seconds;
+  uint32_t threshold = (uint64_t)lastSeconds * BLE_TELEMETRY_TIME_THRESHOLD_PCT / 100;
+  if (threshold < BLE_TELEMETRY_TIME_THRESHOLD_S) {
+    threshold = BLE_TELEMETRY_TIME_THRESHOLD_S;
+  }
+  return difference > threshold;
+}
+
+bool PowerManager::isTelemetryDue(const TelemetrySubscription& subscription, const PowerTelemetrySample& sample, uint32_t now) {
+  if (!subscription.active) {
+    return false;
+  }
+
+  uint32_t elapsed = now - subscription.lastSentTime;
+  if (!subscription.hasSent || elapsed >= BLE_TELEMETRY_KEEPALIVE_MS) {
+    return true;
+  }
+
+  if (elapsed < subscription.periodMs) {
+    return false;
+  }
+
+  const PowerTelemetrySample& last = subscription.lastSent;
+  uint8_t fields = subscription.fields;
+
+  if ((fields & TELEMETRY_FIELD_BATTERY_VOLTAGE) &&
+    abs(sample.batteryVoltageMv - last.batteryVoltageMv) > subscription.voltageThresholdMv) {
+    return true;
+  }
+  if ((fields & TELEMETRY_FIELD_BATTERY_CURRENT) &&
+    abs(sample.batteryCurrentMa - last.batteryCurrentMa) > subscription.currentThresholdMa) {
+    return true;
+  }
+  if ((fields & TELEMETRY_FIELD_BATTERY_PERCENTAGE) &&
+    abs(sample.batteryPercentage - last.batteryPercentage) > subscription.percentageThreshold) {
+    return true;
+  }
+  if ((fields & TELEMETRY_FIELD_CHARGER_VOLTAGE) &&
+    abs(sample.chargerVoltageMv - last.chargerVoltageMv) > subscription.voltageThresholdMv) {
+    return true;
+  }
+  if ((fields & TELEMETRY_FIELD_CHARGER_CURRENT) &&
+    abs(sample.chargerCurrentMa - last.chargerCurrentMa) > subscription.currentThresholdMa) {
+    return true;
+  }
+  if ((fields & TELEMETRY_FIELD_TIME_TO_DISCHARGE) && isTimeEstimateChanged(sample.toFullyDischargeS, last.toFullyDischargeS)) {
+    return true;
+  }
+  if ((fields & TELEMETRY_FIELD_TIME_TO_CHARGE) && isTimeEstimateChanged(sample.toFullyChargeS, last.toFullyChargeS)) {
+    return true;
+  }
+  if ((fields & TELEMETRY_FIELD_STATE) && sample.state != last.state) {
+    return true;
+  }
+
+  return false;
+}
+
+size_t PowerManager::packTelemetry(uint8_t fields, const PowerTelemetrySample& sample, uint8_t* buffer, size_t bufferSize) {
+  if (!buffer || bufferSize < BLE_TELEMETRY_MAX_PACKET_SIZE) {
+    return 0;
+  }
+
+  size_t offset = 0;
+  buffer[offset++] = fields;
+
+  auto put = [&](const void* value, size_t size) {
+    memcpy(buffer + offset, value, size);
+    offset += size;
+  };
+
+  if (fields & TELEMETRY_FIELD_BATTERY_VOLTAGE) put(&sample.batteryVoltageMv, sizeof(sample.batteryVoltageMv));
+  if (fields & TELEMETRY_FIELD_BATTERY_CURRENT) put(&sample.batteryCurrentMa, sizeof(sample.batteryCurrentMa));
+  if (fields & TELEMETRY_FIELD_BATTERY_PERCENTAGE) put(&sample.batteryPercentage, sizeof(sample.batteryPercentage));
+  if (fields & TELEMETRY_FIELD_CHARGER_VOLTAGE) put(&sample.chargerVoltageMv, sizeof(sample.chargerVoltageMv));
+  if (fields & TELEMETRY_FIELD_CHARGER_CURRENT) put(&sample.chargerCurrentMa, sizeof(sample.chargerCurrentMa));
+  if (fields & TELEMETRY_FIELD_TIME_TO_DISCHARGE) put(&sample.toFullyDischargeS, sizeof(sample.toFullyDischargeS));
+  if (fields & TELEMETRY_FIELD_TIME_TO_CHARGE) put(&sample.toFullyChargeS, sizeof(sample.toFullyChargeS));
+  if (fields & TELEMETRY_FIELD_STATE) put(&sample.state, sizeof(sample.state));
+
+  return offset;
 }
 
 void PowerManager::trySetSBCPower(bool on) {
@@ -5,6 +5,7 @@
 #include "managers/PowerManager.h"
 #include <classes/GripDeckVendorHID.h>
 #include <utils/DebugSerial.h>
+#include <Preferences.h>
 
 #include <USB.h>
 #include "esp32-hal-tinyusb.h"
@@ -23,6 +24,7 @@ USBManager::USBManager() : usbConnected(false), initialized(false), sequenceCoun
   instance = this;
   hidQueue = nullptr;
   hidMutex = nullptr;
+  queueMutex = nullptr;
   vendorDevice = nullptr;
   vendorResponseReady = false;
   memset(&vendorResponse, 0, sizeof(vendorResponse));
@@ -38,6 +40,9 @@ USBManager::~USBManager() {
   if (hidMutex) {
     vSemaphoreDelete(hidMutex);
   }
+  if (queueMutex) {
+    vSemaphoreDelete(queueMutex);
+  }
   if (vendorDevice) {
     delete vendorDevice;
     vendorDevice = nullptr;
@@ -84,7 +89,7 @@ bool USBManager::initializeFreeRTOSResources() {
 
   DEBUG_PRINTLN("Initializing FreeRTOS resources for USBManager...");
 
-  hidQueue = xQueueCreate(10, sizeof(HIDMessage));
+  hidQueue = xQueueCreate(QUEUE_SIZE_HID, sizeof(HIDMessage));
   if (!hidQueue) {
     DEBUG_PRINTLN("ERROR: Failed to create HID queue");
     return false;
@@ -98,6 +103,16 @@ bool USBManager::initializeFreeRTOSResources() {
     return false;
   }
 
+  queueMutex = xSemaphoreCreateMutex();
+  if (!queueMutex) {
+    DEBUG_PRINTLN("ERROR: Failed to create HID queue mutex");
+    vSemaphoreDelete(hidMutex);
+    hidMutex = nullptr;
+    vQueueDelete(hidQueue);
+    hidQueue = nullptr;
+    return false;
+  }
+
   initialized = true;
   DEBUG_PRINTLN("FreeRTOS resources initialized successfully");
   return true;
@@ -155,6 +170,8 @@ bool USBManager::begin() {
 #endif
 
   keyboard.begin();
+  nkroKeyboard.begin();
+  loadKeyboardLayout();
   delay(100);
   DEBUG_PRINTLN("USB keyboard initialized");
 
@@ -166,6 +183,7 @@ bool USBManager::begin() {
   DEBUG_PRINTLN("USB gamepad initialized");
 
   consumerControl.begin();
+  pointer.begin();
   DEBUG_PRINTLN("USB consumer control initialized");
 
   hid.begin();
@@ -215,7 +233,10 @@ void USBManager::update() {
     usbConnected = currentStatus;
   }
 
+  processReleaseTimers();
+  updateTyping();
   processHIDCommands();
+  updateMotion();
 }
 
 void USBManager::executeHIDCommand(const HIDMessage& command) {
@@ -260,15 +281,7 @@ void USBManager::executeHIDCommand(const HIDMessage& command) {
     }
 
     DEBUG_PRINTF("Keyboard: Pressing key code %d\n", command.key);
-    keyboard.press(command.key);
-    DEBUG_PRINTF("Key %d pressed\n", command.key);
-
-    delay(USB_HID_KEYBOARD_PRESS_DELAY);
-    keyboard.release(command.key);
-    DEBUG_PRINTF("Key %d released\n", command.key);
-
-    keyboard.releaseAll();
-    DEBUG_PRINTLN("Keyboard HID report sent");
+    pressWithRelease(HID_TIMER_KEY_RELEASE, command.key, USB_HID_KEYBOARD_PRESS_DELAY);
     break;
 
   case HID_KEYBOARD_HOLD:
@@ -277,128 +290,183 @@ void USBManager::executeHIDCommand(const HIDMessage& command) {
       DEBUG_PRINTF("Invalid key code: %d\n", command.key);
       break;
     }
-    keyboard.press(command.key);
+    cancelRelease(HID_TIMER_KEY_RELEASE, command.key);
+    pressKey(command.key);
     DEBUG_PRINTF("Holding key %d \n", command.key);
     break;
 
   case HID_KEYBOARD_RELEASE:
     DEBUG_PRINTF("Keyboard: Releasing key code %d\n", command.key);
-    keyboard.release(command.key);
+    cancelRelease(HID_TIMER_KEY_RELEASE, command.key);
+    releaseKey(command.key);
     break;
 
   case HID_KEYBOARD_TYPE:
-    DEBUG_PRINTF("Keyboard: Typing text: %s\n", command.text);
-    keyboard.print(command.text);
+    DEBUG_PRINTF("Keyboard: Typing %u characters at %u/s\n", command.textLength, typing.getRate());
+    typing.start(&textPool, command.textOffset, command.textLength, millis());
     break;
 
   case HID_MOUSE_MOVE:
+  {
     DEBUG_PRINTF("Mouse: Moving by (%d, %d)\n", command.x, command.y);
-    mouse.move(command.x, command.y);
+    int16_t x = command.x;
+    int16_t y = command.y;
+    do {
+      int8_t stepX = constrain(x, -127, 127);
+      int8_t stepY = constrain(y, -127, 127);
+      sendMouseMove(stepX, stepY, 0, 0);
+      x -= stepX;
+      y -= stepY;
+    } while (x != 0 || y != 0);
     break;
+  }
 
   case HID_MOUSE_PRESS:
     DEBUG_PRINTF("Mouse: Pressing buttons %d\n", command.buttons);
-    if (command.buttons & 0x01) {
-      mouse.press(MOUSE_LEFT);
-      delay(USB_HID_MOUSE_PRESS_DELAY);
-      mouse.release(MOUSE_LEFT);
-    }
-    if (command.buttons & 0x02) {
-      mouse.press(MOUSE_RIGHT);
-      delay(USB_HID_MOUSE_PRESS_DELAY);
-      mouse.release(MOUSE_RIGHT);
-    }
-    if (command.buttons & 0x04) {
-      mouse.press(MOUSE_MIDDLE);
-      delay(USB_HID_MOUSE_PRESS_DELAY);
-      mouse.release(MOUSE_MIDDLE);
-    }
+    if (command.buttons & 0x01) pressWithRelease(HID_TIMER_MOUSE_RELEASE, MOUSE_LEFT, USB_HID_MOUSE_PRESS_DELAY);
+    if (command.buttons & 0x02) pressWithRelease(HID_TIMER_MOUSE_RELEASE, MOUSE_RIGHT, USB_HID_MOUSE_PRESS_DELAY);
+    if (command.buttons & 0x04) pressWithRelease(HID_TIMER_MOUSE_RELEASE, MOUSE_MIDDLE, USB_HID_MOUSE_PRESS_DELAY);
     break;
 
   case HID_MOUSE_HOLD:
     DEBUG_PRINTF("Mouse: Holding buttons %d\n", command.buttons);
-    if (command.buttons & 0x01) mouse.press(MOUSE_LEFT);
-    if (command.buttons & 0x02) mouse.press(MOUSE_RIGHT);
-    if (command.buttons & 0x04) mouse.press(MOUSE_MIDDLE);
+    if (command.buttons & 0x01) { cancelRelease(HID_TIMER_MOUSE_RELEASE, MOUSE_LEFT); setMouseButtons(mouseButtons | MOUSE_LEFT); }
+    if (command.buttons & 0x02) { cancelRelease(HID_TIMER_MOUSE_RELEASE, MOUSE_RIGHT); setMouseButtons(mouseButtons | MOUSE_RIGHT); }
+    if (command.buttons & 0x04) { cancelRelease(HID_TIMER_MOUSE_RELEASE, MOUSE_MIDDLE); setMouseButtons(mouseButtons | MOUSE_MIDDLE); }
     break;
 
   case HID_MOUSE_RELEASE:
     DEBUG_PRINTF("Mouse: Releasing buttons %d\n", command.buttons);
-    if (command.buttons & 0x01) mouse.release(MOUSE_LEFT);
-    if (command.buttons & 0x02) mouse.release(MOUSE_RIGHT);
-    if (command.buttons & 0x04) mouse.release(MOUSE_MIDDLE);
+    if (command.buttons & 0x01) { cancelRelease(HID_TIMER_MOUSE_RELEASE, MOUSE_LEFT); setMouseButtons(mouseButtons & ~MOUSE_LEFT); }
+    if (command.buttons & 0x02) { cancelRelease(HID_TIMER_MOUSE_RELEASE, MOUSE_RIGHT); setMouseButtons(mouseButtons & ~MOUSE_RIGHT); }
+    if (command.buttons & 0x04) { cancelRelease(HID_TIMER_MOUSE_RELEASE, MOUSE_MIDDLE); setMouseButtons(mouseButtons & ~MOUSE_MIDDLE); }
     break;
 
   case HID_MOUSE_SCROLL:
   {
     DEBUG_PRINTF("Mouse: Scrolling by x=%d, y=%d\n", command.x, command.y);
-    int8_t horizontal = (command.x > 127) ? 127 : (command.x < -128) ? -128 : (int8_t)command.x;
-    int8_t vertical = (command.y > 127) ? 127 : (command.y < -128) ? -128 : (int8_t)command.y;
-    mouse.move(0, 0, vertical, horizontal);
-    DEBUG_PRINTF("Mouse: Scroll executed - vertical: %d, horizontal: %d\n", vertical, horizontal);
+    int16_t horizontal = command.x;
+    int16_t vertical = command.y;
+    do {
+      int8_t stepHorizontal = constrain(horizontal, -127, 127);
+      int8_t stepVertical = constrain(vertical, -127, 127);
+      sendMouseMove(0, 0, stepVertical, stepHorizontal);
+      horizontal -= stepHorizontal;
+      vertical -= stepVertical;
+    } while (horizontal != 0 || vertical != 0);
+    DEBUG_PRINTF("Mouse: Scroll executed - vertical: %d, horizontal: %d\n", command.y, command.x);
     break;
   }
 
   case HID_GAMEPAD_PRESS:
     DEBUG_PRINTF("Gamepad: Pressing button %d\n", command.key);
-    if (command.key == 0 || command.key > 16) {
+    if (command.key == 0 || command.key > USB_GAMEPAD_BUTTON_COUNT) {
       DEBUG_PRINTF("Invalid gamepad button: %d\n", command.key);
       break;
     }
-    gamepad.pressButton(command.key);
-    delay(USB_HID_GAMEPAD_PRESS_DELAY);
-    gamepad.releaseButton(command.key);
+    pressWithRelease(HID_TIMER_GAMEPAD_RELEASE, command.key, USB_HID_GAMEPAD_PRESS_DELAY);
     break;
 
   case HID_GAMEPAD_HOLD:
     DEBUG_PRINTF("Gamepad: Holding button %d\n", command.key);
-    if (command.key == 0 || command.key > 16) {
+    if (command.key == 0 || command.key > USB_GAMEPAD_BUTTON_COUNT) {
       DEBUG_PRINTF("Invalid gamepad button: %d\n", command.key);
       break;
     }
-    gamepad.pressButton(command.key);
+    cancelRelease(HID_TIMER_GAMEPAD_RELEASE, command.key);
+    setGamepadButton(command.key, true);
     break;
 
   case HID_GAMEPAD_RELEASE:
     DEBUG_PRINTF("Gamepad: Releasing button %d\n", command.key);
-    if (command.key == 0 || command.key > 16) {
+    if (command.key == 0 || command.key > USB_GAMEPAD_BUTTON_COUNT) {
       DEBUG_PRINTF("Invalid gamepad button: %d\n", command.key);
       break;
     }
-    gamepad.releaseButton(command.key);
+    cancelRelease(HID_TIMER_GAMEPAD_RELEASE, command.key);
+    setGamepadButton(command.key, false);
     break;
 
   case HID_GAMEPAD_BUTTON:
     DEBUG_PRINTF("Gamepad: Button %d, pressed: %s\n", command.key, (command.buttons & 0x80) ? "true" : "false");
-    if (command.key == 0 || command.key > 16) {
+    if (command.key == 0 || command.key > USB_GAMEPAD_BUTTON_COUNT) {
       DEBUG_PRINTF("Invalid gamepad button: %d\n", command.key);
       break;
     }
+    cancelRelease(HID_TIMER_GAMEPAD_RELEASE, command.key);
     if (command.buttons & 0x80) {
-      gamepad.pressButton(command.key);
+      setGamepadButton(command.key, true);
     }
     else {
-      gamepad.releaseButton(command.key);
+      setGamepadButton(command.key, false);
     }
     break;
 
   case HID_GAMEPAD_AXIS_RIGHT:
     DEBUG_PRINTF("Gamepad: Right axis movement (%d, %d)\n", command.x, command.y);
-    gamepad.rightStick(command.x, command.y);
+    stickMotion[HID_STICK_RIGHT].active = false;
+    setStick(HID_STICK_RIGHT, command.x, command.y);
     break;
 
   case HID_GAMEPAD_AXIS_LEFT:
     DEBUG_PRINTF("Gamepad: Left axis movement (%d, %d)\n", command.x, command.y);
-    gamepad.leftStick(command.x, command.y);
+    stickMotion[HID_STICK_LEFT].active = false;
+    setStick(HID_STICK_LEFT, command.x, command.y);
+    break;
+
+  case HID_MOUSE_VELOCITY:
+    DEBUG_PRINTF("Mouse: Velocity (%d, %d) px/s for %u ms\n", command.x, command.y, command.duration);
+    mouseMotion.active = (command.x != 0 || command.y != 0) && command.duration > 0;
+    mouseMotion.velocityX = command.x;
+    mouseMotion.velocityY = command.y;
+    mouseMotion.lastFrameTime = millis();
+    mouseMotion.endTime = mouseMotion.lastFrameTime + command.duration;
+    mouseMotion.remainderX = 0;
+    mouseMotion.remainderY = 0;
+    mouseMotion.nextFrameTime = mouseMotion.lastFrameTime + reportIntervalMs[HID_REPORT_MOUSE];
+    break;
+
+  case HID_GAMEPAD_AXIS_TARGET: {
+    DEBUG_PRINTF("Gamepad: Stick %d to (%d, %d) over %u ms\n", command.key, command.x, command.y, command.duration);
+    StickMotion& stick = stickMotion[command.key];
+    if (command.duration == 0) {
+      stick.active = false;
+      setStick(command.key, command.x, command.y);
+      break;
+    }
+    stick.active = true;
+    stick.fromX = stick.x;
+    stick.fromY = stick.y;
+    stick.toX = command.x;
+    stick.toY = command.y;
+    stick.startTime = millis();
+    stick.rampMs = command.duration;
+    stick.nextFrameTime = stick.startTime + reportIntervalMs[HID_REPORT_GAMEPAD];
     break;
+  }
 
   case HID_SYSTEM_POWER:
     DEBUG_PRINTLN("System: Sending HID Consumer Control Power key");
-    consumerControl.press(CONSUMER_CONTROL_POWER);
-    delay(200);
-    consumerControl.release();
+    pressWithRelease(HID_TIMER_CONSUMER_RELEASE, 0, USB_HID_SYSTEM_POWER_PRESS_DELAY);
+    break;
+
+  case HID_KEYBOARD_REPORT:
+  case HID_MOUSE_REPORT:
+  case HID_GAMEPAD_REPORT:
+    sendRawReport(command);
     break;
 
+  case HID_POINTER_MOVE: {
+    // Pixel centers of the client surface spread over the full logical range, so both edges are reachable
+    uint16_t x = (uint16_t)command.x < pointerSurfaceWidth ? (uint16_t)command.x : pointerSurfaceWidth - 1;
+    uint16_t y = (uint16_t)command.y < pointerSurfaceHeight ? (uint16_t)command.y : pointerSurfaceHeight - 1;
+    uint16_t pointerX = (uint32_t)x * USB_POINTER_LOGICAL_MAX / (pointerSurfaceWidth - 1);
+    uint16_t pointerY = (uint32_t)y * USB_POINTER_LOGICAL_MAX / (pointerSurfaceHeight - 1);
+    DEBUG_PRINTF("Pointer: (%u, %u) -> (%u, %u), buttons %d\n", x, y, pointerX, pointerY, command.buttons);
+    rateMeter.recordReport(HID_REPORT_POINTER, pointer.move(pointerX, pointerY, command.buttons));
+    break;
+  }
+
   default:
     DEBUG_PRINTF("Unknown HID command: %d\n", command.command);
     break;
@@ -418,13 +486,794 @@ void USBManager::processHIDCommands() {
   }
 
   HIDMessage message;
+  HIDMessage next;
+  playoutPending = false;
+
+  // Whatever comes after the text waits until it is typed
+  while (!typing.isActive() && xQueuePeek(hidQueue, &message, 0) == pdTRUE) {
+    uint32_t now = millis();
+
+    // In jitter buffer mode the head event waits until timestamp + delay, the rest queue up behind it in order
+    if (!isPlayoutDue(message, now)) {
+      nextPlayoutTime = message.timestamp + jitterDelayMs;
+      playoutPending = true;
+      break;
+    }
+
+    // A press whose release can't be scheduled stays at the head until pending releases free the wheel
+    if (getReleaseTimerCount(message) > releaseTimers.getFreeCount()) {
+      DEBUG_VERBOSE_PRINTLN("Release timer wheel full, holding the queue head");
+      break;
+    }
+
+    if (xQueueReceive(hidQueue, &message, 0) != pdTRUE) {
+      break;
+    }
+    if (jitterEnabled) {
+      recordPlayout(message, now);
+    }
+
+    // A burst of moves becomes one report carrying the newest position instead of one report per message
+    uint8_t coalesced = 0;
+    while (xQueuePeek(hidQueue, &next, 0) == pdTRUE && isPlayoutDue(next, now) && coalesceHIDMessage(message, next)) {
+      xQueueReceive(hidQueue, &next, 0);
+      if (jitterEnabled) {
+        recordPlayout(next, now);
+      }
+      coalesced++;
+    }
 
-  while (xQueueReceive(hidQueue, &message, 0) == pdTRUE) {
     DEBUG_PRINTF("=== Processing HID command from queue ===\n");
-    DEBUG_PRINTF("Command: %d, Key: %d, X: %d, Y: %d, Buttons: %d, Text: '%s'\n",
-      message.command, message.key, message.x, message.y, message.buttons, message.text);
+    DEBUG_PRINTF("Command: %d, Key: %d, X: %d, Y: %d, Buttons: %d, Coalesced: %d\n",
+      message.command, message.key, message.x, message.y, message.buttons, coalesced);
     executeHIDCommand(message);
+
+    // Text that could not be typed (USB not connected) is done with right away, the pool frees in queue order
+    if (message.command == HID_KEYBOARD_TYPE && !typing.isActive()) {
+      releaseText(message.textLength);
+    }
+  }
+}
+
+void USBManager::updateTyping() {
+  if (!typing.isActive()) {
+    return;
+  }
+
+  if (!xSemaphoreTake(hidMutex, pdMS_TO_TICKS(10))) {
+    return;
+  }
+
+  KeyReport report;
+  uint32_t now = millis();
+  uint32_t late = typing.getFrameLateness(now);
+  if (typing.nextFrame(now, report)) {
+    rateMeter.recordMissed(HID_REPORT_KEYBOARD, late / reportIntervalMs[HID_REPORT_KEYBOARD]);
+    sendKeyboardFrame(report);
+  }
+
+  xSemaphoreGive(hidMutex);
+
+  if (!typing.isActive()) {
+    DEBUG_PRINTF("Keyboard: Typed %u characters\n", typing.getLength());
+    releaseText(typing.getLength());
+  }
+}
+
+void USBManager::releaseText(uint16_t length) {
+  if (xSemaphoreTake(queueMutex, portMAX_DELAY)) {
+    textPool.release(length);
+    xSemaphoreGive(queueMutex);
+  }
+}
+
+void USBManager::loadKeyboardLayout() {
+  Preferences preferences;
+  if (!preferences.begin(USB_PREFS_NAMESPACE, true)) {
+    return;
+  }
+
+  HIDLayoutId layout = (HIDLayoutId)preferences.getUChar(USB_PREFS_LAYOUT_KEY, HID_LAYOUT_US);
+  HIDUnicodeMode unicodeMode = (HIDUnicodeMode)preferences.getUChar(USB_PREFS_UNICODE_KEY, HID_UNICODE_NONE);
+  nkroActive = preferences.getBool(USB_PREFS_NKRO_KEY, USB_NKRO_ENABLED);
+  preferences.end();
+
+  DEBUG_PRINTF("Keyboard: Using the %s keyboard\n", nkroActive ? "NKRO" : "6KRO");
+
+  if (!typing.setLayout(layout, unicodeMode)) {
+    DEBUG_PRINTLN("ERROR: Stored keyboard layout is invalid, using US");
+    return;
+  }
+  DEBUG_PRINTF("Keyboard layout: %s, Unicode input: %s\n", getLayoutName(layout), getUnicodeModeName(unicodeMode));
+}
+
+bool USBManager::setKeyboardLayout(HIDLayoutId layout, HIDUnicodeMode unicodeMode) {
+  // The HID task reads the layout while it types, swap it between two keystrokes
+  if (!hidMutex || !xSemaphoreTake(hidMutex, pdMS_TO_TICKS(100))) {
+    DEBUG_PRINTLN("ERROR: Failed to acquire HID mutex for layout switch");
+    return false;
+  }
+
+  bool changed = typing.setLayout(layout, unicodeMode);
+  xSemaphoreGive(hidMutex);
+  if (!changed) {
+    return false;
+  }
+
+  Preferences preferences;
+  if (!preferences.begin(USB_PREFS_NAMESPACE, false)) {
+    DEBUG_PRINTLN("ERROR: Failed to open USB preferences");
+    return true;
+  }
+
+  preferences.putUChar(USB_PREFS_LAYOUT_KEY, layout);
+  preferences.putUChar(USB_PREFS_UNICODE_KEY, unicodeMode);
+  preferences.end();
+
+  DEBUG_PRINTF("Keyboard layout set to %s, Unicode input: %s\n", getLayoutName(layout), getUnicodeModeName(unicodeMode));
+  return true;
+}
+
+bool USBManager::setNKROEnabled(bool enabled) {
+  // There is no boot protocol to detect on this core, so the client picks the keyboard the host can parse
+  if (!hidMutex || !xSemaphoreTake(hidMutex, pdMS_TO_TICKS(100))) {
+    DEBUG_PRINTLN("ERROR: Failed to acquire HID mutex for keyboard switch");
+    return false;
+  }
+
+  if (enabled != nkroActive) {
+    // Keys held on one keyboard would otherwise stay down for good
+    releaseTimers.cancelAll(HID_TIMER_KEY_RELEASE);
+    if (nkroActive) {
+      nkroKeyboard.releaseAll();
+    }
+    else {
+      KeyReport released = {};
+      sendKeyboardFrame(released);
+    }
+    nkroActive = enabled;
+  }
+  xSemaphoreGive(hidMutex);
+
+  Preferences preferences;
+  if (preferences.begin(USB_PREFS_NAMESPACE, false)) {
+    preferences.putBool(USB_PREFS_NKRO_KEY, enabled);
+    preferences.end();
+  }
+  else {
+    DEBUG_PRINTLN("ERROR: Failed to open USB preferences");
+  }
+
+  DEBUG_PRINTF("Keyboard: Using the %s keyboard\n", enabled ? "NKRO" : "6KRO");
+  return true;
+}
+
+void USBManager::clearTypingCarry() {
+  if (!hidMutex || !xSemaphoreTake(hidMutex, pdMS_TO_TICKS(100))) {
+    DEBUG_PRINTLN("ERROR: Failed to acquire HID mutex to clear the typing carry");
+    return;
+  }
+
+  typing.clearCarry();
+  xSemaphoreGive(hidMutex);
+}
+
+const char* USBManager::getTypingInfo() {
+  static char info[80];
+
+  uint16_t freeBytes = 0;
+  if (queueMutex && xSemaphoreTake(queueMutex, pdMS_TO_TICKS(10))) {
+    freeBytes = textPool.available();
+    xSemaphoreGive(queueMutex);
+  }
+
+  snprintf(info, sizeof(info), "HID_TYPING_INFO:%u|%u|%u|%s|%s",
+    typing.getRate(),
+    USB_HID_TEXT_POOL_SIZE - freeBytes,
+    freeBytes,
+    getLayoutName(typing.getLayout()),
+    getUnicodeModeName(typing.getUnicodeMode()));
+
+  return info;
+}
+
+bool USBManager::isPlayoutDue(const HIDMessage& message, uint32_t now) const {
+  return !jitterEnabled || (int32_t)(message.timestamp + jitterDelayMs - now) <= 0;
+}
+
+bool USBManager::coalesceHIDMessage(HIDMessage& message, const HIDMessage& next) {
+  if (next.command != message.command) {
+    return false;
+  }
+
+  switch (message.command) {
+  case HID_MOUSE_MOVE:
+  case HID_MOUSE_SCROLL: {
+    // Relative, so they add up; executeHIDCommand splits the sum into int8 reports
+    int32_t x = (int32_t)message.x + next.x;
+    int32_t y = (int32_t)message.y + next.y;
+    if (x < INT16_MIN || x > INT16_MAX || y < INT16_MIN || y > INT16_MAX) {
+      return false;
+    }
+    message.x = x;
+    message.y = y;
+    return true;
+  }
+
+  case HID_GAMEPAD_AXIS_LEFT:
+  case HID_GAMEPAD_AXIS_RIGHT:
+    // Absolute, only the latest position matters
+    message.x = next.x;
+    message.y = next.y;
+    message.timestamp = next.timestamp;
+    return true;
+
+  case HID_MOUSE_REPORT: {
+    // Motion adds up while the buttons stay the same, a button change has to reach the host on its own
+    HIDMouseReport current, following;
+    memcpy(&current, message.report, sizeof(current));
+    memcpy(&following, next.report, sizeof(following));
+    int16_t x = current.x + following.x;
+    int16_t y = current.y + following.y;
+    int16_t wheel = current.wheel + following.wheel;
+    int16_t pan = current.pan + following.pan;
+    if (current.buttons != following.buttons || x < -127 || x > 127 || y < -127 || y > 127 ||
+      wheel < -127 || wheel > 127 || pan < -127 || pan > 127) {
+      return false;
+    }
+    current.x = x;
+    current.y = y;
+    current.wheel = wheel;
+    current.pan = pan;
+    memcpy(message.report, &current, sizeof(current));
+    return true;
+  }
+
+  case HID_GAMEPAD_REPORT: {
+    // Axes are absolute, but buttons and hat must not skip a state
+    HIDGamepadReport current, following;
+    memcpy(&current, message.report, sizeof(current));
+    memcpy(&following, next.report, sizeof(following));
+    if (current.buttons != following.buttons || current.hat != following.hat) {
+      return false;
+    }
+    memcpy(message.report, next.report, sizeof(HIDGamepadReport));
+    message.timestamp = next.timestamp;
+    return true;
+  }
+
+  case HID_POINTER_MOVE:
+    // Absolute, the latest position wins unless the buttons change
+    if (next.buttons != message.buttons) {
+      return false;
+    }
+    message.x = next.x;
+    message.y = next.y;
+    message.timestamp = next.timestamp;
+    return true;
+
+  case HID_KEYBOARD_REPORT:
+    // Only a repeat of the same state can go
+    return memcmp(message.report, next.report, sizeof(KeyReport)) == 0;
+
+  default:
+    return false;
+  }
+}
+
+void USBManager::sendRawReport(const HIDMessage& command) {
+  // Caller holds hidMutex. The report is the whole device state, pending releases and motion would only undo it.
+  switch (command.command) {
+  case HID_KEYBOARD_REPORT: {
+    KeyReport report;
+    memcpy(&report, command.report, sizeof(report));
+    DEBUG_VERBOSE_PRINTF("Keyboard: Report modifiers 0x%02X, keys %02X %02X %02X %02X %02X %02X\n", report.modifiers,
+      report.keys[0], report.keys[1], report.keys[2], report.keys[3], report.keys[4], report.keys[5]);
+    releaseTimers.cancelAll(HID_TIMER_KEY_RELEASE);
+    sendKeyboardFrame(report);
+    break;
+  }
+
+  case HID_MOUSE_REPORT: {
+    HIDMouseReport report;
+    memcpy(&report, command.report, sizeof(report));
+    DEBUG_VERBOSE_PRINTF("Mouse: Report buttons 0x%02X, move (%d, %d), wheel %d, pan %d\n",
+      report.buttons, report.x, report.y, report.wheel, report.pan);
+    releaseTimers.cancelAll(HID_TIMER_MOUSE_RELEASE);
+    mouseMotion.active = false;
+    // Later moves and button commands keep these buttons down
+    mouseButtons = report.buttons;
+    rateMeter.recordReport(HID_REPORT_MOUSE, hid.SendReport(HID_REPORT_ID_MOUSE, &report, sizeof(report)));
+    break;
+  }
+
+  case HID_GAMEPAD_REPORT: {
+    HIDGamepadReport report;
+    memcpy(&report, command.report, sizeof(report));
+    DEBUG_VERBOSE_PRINTF("Gamepad: Report sticks (%d, %d) (%d, %d), triggers %d %d, hat %u, buttons 0x%08X\n",
+      report.leftX, report.leftY, report.rightX, report.rightY, report.leftTrigger, report.rightTrigger, report.hat, report.buttons);
+    releaseTimers.cancelAll(HID_TIMER_GAMEPAD_RELEASE);
+    stickMotion[HID_STICK_LEFT] = { false, report.leftX, report.leftY };
+    stickMotion[HID_STICK_RIGHT] = { false, report.rightX, report.rightY };
+    // send() also updates the wrapper's state, so single button and stick commands carry on from this report
+    rateMeter.recordReport(HID_REPORT_GAMEPAD, gamepad.send(report.leftX, report.leftY, report.rightX, report.rightY,
+      report.leftTrigger, report.rightTrigger, report.hat, report.buttons));
+    break;
+  }
+
+  default:
+    break;
+  }
+}
+
+// 6KRO key state, like USBHIDKeyboard::press/release but on a report a raw report can replace
+static bool updateKeyReport(KeyReport& report, uint8_t key, bool pressed) {
+  HIDKeyStroke stroke;
+  if (!lookupKeyCode(key, stroke)) {
+    return false;
+  }
+
+  if (pressed) {
+    report.modifiers |= stroke.modifiers;
+  }
+  else {
+    report.modifiers &= ~stroke.modifiers;
+  }
+  if (stroke.keycode == 0) {
+    return true;
+  }
+
+  for (uint8_t i = 0; i < 6; i++) {
+    if (report.keys[i] != stroke.keycode) {
+      continue;
+    }
+    if (!pressed) {
+      memmove(&report.keys[i], &report.keys[i + 1], 5 - i);
+      report.keys[5] = 0;
+    }
+    return true;
+  }
+
+  if (pressed) {
+    for (uint8_t i = 0; i < 6; i++) {
+      if (report.keys[i] == 0) {
+        report.keys[i] = stroke.keycode;
+        return true;
+      }
+    }
+    // Six keys already down, the 6KRO report can't carry another one
+    return false;
+  }
+  return true;
+}
+
+void USBManager::pressKey(uint8_t key) {
+  // Caller holds hidMutex
+  if (nkroActive) {
+    rateMeter.recordReport(HID_REPORT_KEYBOARD, nkroKeyboard.press(key));
+  }
+  else if (updateKeyReport(keyboardReport, key, true)) {
+    keyboard.sendReport(&keyboardReport);
+    rateMeter.recordReport(HID_REPORT_KEYBOARD, true);
+  }
+}
+
+void USBManager::releaseKey(uint8_t key) {
+  // Caller holds hidMutex
+  if (nkroActive) {
+    rateMeter.recordReport(HID_REPORT_KEYBOARD, nkroKeyboard.release(key));
+  }
+  else if (updateKeyReport(keyboardReport, key, false)) {
+    keyboard.sendReport(&keyboardReport);
+    rateMeter.recordReport(HID_REPORT_KEYBOARD, true);
+  }
+}
+
+void USBManager::sendKeyboardFrame(KeyReport& report) {
+  // Caller holds hidMutex. The frame replaces the key state, so single key commands carry on from it.
+  if (nkroActive) {
+    rateMeter.recordReport(HID_REPORT_KEYBOARD, nkroKeyboard.sendReport(report));
+  }
+  else {
+    keyboardReport = report;
+    keyboard.sendReport(&keyboardReport);
+    rateMeter.recordReport(HID_REPORT_KEYBOARD, true);
+  }
+}
+
+void USBManager::sendMouseMove(int8_t x, int8_t y, int8_t wheel, int8_t pan) {
+  // Caller holds hidMutex
+  HIDMouseReport report = { mouseButtons, x, y, wheel, pan };
+  rateMeter.recordReport(HID_REPORT_MOUSE, hid.SendReport(HID_REPORT_ID_MOUSE, &report, sizeof(report)));
+}
+
+void USBManager::setMouseButtons(uint8_t buttons) {
+  // Caller holds hidMutex, a report only goes out when the buttons change, like USBHIDMouse
+  if (buttons == mouseButtons) {
+    return;
+  }
+  mouseButtons = buttons;
+  sendMouseMove(0, 0, 0, 0);
+}
+
+uint8_t USBManager::getReleaseTimerCount(const HIDMessage& message) const {
+  switch (message.command) {
+  case HID_KEYBOARD_PRESS:
+  case HID_GAMEPAD_PRESS:
+  case HID_SYSTEM_POWER:
+    return 1;
+  case HID_MOUSE_PRESS:
+    return ((message.buttons & 0x01) != 0) + ((message.buttons & 0x02) != 0) + ((message.buttons & 0x04) != 0);
+  default:
+    return 0;
+  }
+}
+
+void USBManager::pressWithRelease(HIDTimerAction action, uint8_t code, uint16_t holdMs) {
+  // Caller holds hidMutex. Pressing again while the release is pending re-triggers the press.
+  if (releaseTimers.cancel(action, code)) {
+    fireRelease({ action, code });
+  }
+
+  switch (action) {
+  case HID_TIMER_KEY_RELEASE: pressKey(code); break;
+  case HID_TIMER_MOUSE_RELEASE: setMouseButtons(mouseButtons | code); break;
+  case HID_TIMER_GAMEPAD_RELEASE: setGamepadButton(code, true); break;
+  case HID_TIMER_CONSUMER_RELEASE: consumerControl.press(CONSUMER_CONTROL_POWER); break;
+  }
+
+  // processHIDCommands only hands over a press once the wheel has room, so this is not expected to fail
+  if (!releaseTimers.schedule({ action, code }, holdMs, millis())) {
+    DEBUG_PRINTLN("ERROR: Release timer wheel full, releasing right away");
+    fireRelease({ action, code });
+  }
+}
+
+void USBManager::cancelRelease(HIDTimerAction action, uint8_t code) {
+  // Caller holds hidMutex, an explicit hold or release takes over from a pending timed release
+  releaseTimers.cancel(action, code);
+}
+
+void USBManager::fireRelease(const HIDTimer& timer) {
+  switch (timer.action) {
+  case HID_TIMER_KEY_RELEASE: releaseKey(timer.code); break;
+  case HID_TIMER_MOUSE_RELEASE: setMouseButtons(mouseButtons & ~timer.code); break;
+  case HID_TIMER_GAMEPAD_RELEASE: setGamepadButton(timer.code, false); break;
+  case HID_TIMER_CONSUMER_RELEASE: consumerControl.release(); break;
+  }
+}
+
+void USBManager::processReleaseTimers() {
+  if (!initialized || !hidMutex || releaseTimers.isEmpty()) {
+    return;
+  }
+
+  if (!xSemaphoreTake(hidMutex, pdMS_TO_TICKS(10))) {
+    return;
+  }
+
+  HIDTimer timer;
+  uint32_t now = millis();
+  while (releaseTimers.popExpired(now, timer)) {
+    DEBUG_VERBOSE_PRINTF("Timed release: action %d, code %d\n", timer.action, timer.code);
+    fireRelease(timer);
+  }
+
+  xSemaphoreGive(hidMutex);
+}
+
+void USBManager::setGamepadButton(uint8_t button, bool pressed) {
+  // Caller holds hidMutex. Buttons are numbered from 1, USBHIDGamepad counts bits from 0.
+  uint8_t bit = button - 1;
+  bool delivered = pressed ? gamepad.pressButton(bit) : gamepad.releaseButton(bit);
+  rateMeter.recordReport(HID_REPORT_GAMEPAD, delivered);
+}
+
+void USBManager::setStick(uint8_t stick, int16_t x, int16_t y) {
+  // Caller holds hidMutex
+  stickMotion[stick].x = x;
+  stickMotion[stick].y = y;
+  bool delivered = stick == HID_STICK_LEFT ? gamepad.leftStick(x, y) : gamepad.rightStick(x, y);
+  rateMeter.recordReport(HID_REPORT_GAMEPAD, delivered);
+}
+
+void USBManager::updateMotion() {
+  if (!isMotionActive() || !usbConnected) {
+    return;
+  }
+
+  if (!xSemaphoreTake(hidMutex, pdMS_TO_TICKS(10))) {
+    return;
+  }
+
+  uint32_t now = millis();
+
+  if (mouseMotion.active && isFrameDue(mouseMotion.nextFrameTime, HID_REPORT_MOUSE, now)) {
+    bool expired = (int32_t)(now - mouseMotion.endTime) >= 0;
+    uint32_t frameEnd = expired ? mouseMotion.endTime : now;
+    int32_t elapsed = (int32_t)(frameEnd - mouseMotion.lastFrameTime);
+    if (elapsed > 0) {
+      mouseMotion.remainderX += mouseMotion.velocityX * elapsed;
+      mouseMotion.remainderY += mouseMotion.velocityY * elapsed;
+      mouseMotion.lastFrameTime = frameEnd;
+    }
+
+    // Whole pixels go out now, the fraction carries into the next frame
+    int32_t stepX = constrain(mouseMotion.remainderX / 1000, -127, 127);
+    int32_t stepY = constrain(mouseMotion.remainderY / 1000, -127, 127);
+    if (stepX != 0 || stepY != 0) {
+      sendMouseMove(stepX, stepY, 0, 0);
+      mouseMotion.remainderX -= stepX * 1000;
+      mouseMotion.remainderY -= stepY * 1000;
+    }
+    // Faster than one report can carry, drop the excess instead of building up a backlog
+    mouseMotion.remainderX = constrain(mouseMotion.remainderX, -127000, 127000);
+    mouseMotion.remainderY = constrain(mouseMotion.remainderY, -127000, 127000);
+
+    if (expired) {
+      DEBUG_PRINTLN("Mouse: Velocity timed out");
+      mouseMotion.active = false;
+    }
+  }
+
+  for (uint8_t i = 0; i < 2; i++) {
+    StickMotion& stick = stickMotion[i];
+    if (!stick.active || !isFrameDue(stick.nextFrameTime, HID_REPORT_GAMEPAD, now)) {
+      continue;
+    }
+
+    uint32_t elapsed = now - stick.startTime;
+    if (elapsed >= stick.rampMs) {
+      stick.active = false;
+      setStick(i, stick.toX, stick.toY);
+      continue;
+    }
+
+    int16_t x = stick.fromX + (int32_t)(stick.toX - stick.fromX) * (int32_t)elapsed / stick.rampMs;
+    int16_t y = stick.fromY + (int32_t)(stick.toY - stick.fromY) * (int32_t)elapsed / stick.rampMs;
+    if (x != stick.x || y != stick.y) {
+      setStick(i, x, y);
+    }
   }
+
+  xSemaphoreGive(hidMutex);
+}
+
+void USBManager::recordPlayout(const HIDMessage& message, uint32_t now) {
+  if (!xSemaphoreTake(queueMutex, pdMS_TO_TICKS(10))) {
+    return;
+  }
+
+  HIDJitterStats& stats = jitterStats;
+  uint32_t latency = now - message.timestamp;
+  stats.events++;
+  stats.totalLatencyMs += latency;
+  if (latency > stats.maxLatencyMs) {
+    stats.maxLatencyMs = latency;
+  }
+  // One USB task tick of slack, the task can not wake any finer than that
+  if (latency > (uint32_t)jitterDelayMs + TASK_INTERVAL_USB) {
+    stats.late++;
+  }
+
+  if (stats.hasLast) {
+    int32_t produced = (int32_t)(message.timestamp - stats.lastTimestamp);
+    int32_t played = (int32_t)(now - stats.lastExecTime);
+    uint32_t jitter = (uint32_t)abs(played - produced);
+    stats.totalJitterMs += jitter;
+    if (jitter > stats.maxJitterMs) {
+      stats.maxJitterMs = jitter;
+    }
+  }
+  stats.hasLast = true;
+  stats.lastTimestamp = message.timestamp;
+  stats.lastExecTime = now;
+
+  xSemaphoreGive(queueMutex);
+}
+
+bool USBManager::setJitterBuffer(bool enabled, uint16_t delayMs) {
+  if (!initialized || !queueMutex || delayMs > USB_JITTER_MAX_DELAY_MS) {
+    return false;
+  }
+
+  if (!xSemaphoreTake(queueMutex, pdMS_TO_TICKS(10))) {
+    DEBUG_PRINTLN("ERROR: Failed to acquire HID queue mutex");
+    return false;
+  }
+
+  jitterEnabled = enabled;
+  jitterDelayMs = delayMs;
+  jitterStats = {};
+
+  xSemaphoreGive(queueMutex);
+  DEBUG_PRINTF("Jitter buffer %s, delay %u ms\n", enabled ? "enabled" : "disabled", delayMs);
+  return true;
+}
+
+const char* USBManager::getJitterInfo() {
+  static char info[96];
+
+  HIDJitterStats stats = {};
+  if (queueMutex && xSemaphoreTake(queueMutex, pdMS_TO_TICKS(10))) {
+    stats = jitterStats;
+    xSemaphoreGive(queueMutex);
+  }
+
+  uint32_t averageLatency = stats.events ? (uint32_t)(stats.totalLatencyMs / stats.events) : 0;
+  uint32_t averageJitter = stats.events > 1 ? (uint32_t)(stats.totalJitterMs / (stats.events - 1)) : 0;
+
+  snprintf(info, sizeof(info), "HID_JITTER_INFO:%d|%u|%lu|%lu|%lu|%lu|%lu|%lu",
+    jitterEnabled ? 1 : 0,
+    jitterDelayMs,
+    stats.events,
+    stats.late,
+    averageLatency,
+    stats.maxLatencyMs,
+    averageJitter,
+    stats.maxJitterMs);
+
+  return info;
+}
+
+uint32_t USBManager::getIdleDelay() const {
+  uint32_t idleDelay = TASK_INTERVAL_USB;
+  if (isMotionActive()) {
+    // Mouse and gamepad can run different intervals, wake for the sooner one
+    idleDelay = USB_REPORT_MAX_INTERVAL_MS;
+    if (mouseMotion.active) {
+      idleDelay = reportIntervalMs[HID_REPORT_MOUSE];
+    }
+    if ((stickMotion[HID_STICK_LEFT].active || stickMotion[HID_STICK_RIGHT].active) && reportIntervalMs[HID_REPORT_GAMEPAD] < idleDelay) {
+      idleDelay = reportIntervalMs[HID_REPORT_GAMEPAD];
+    }
+  }
+  else if (!releaseTimers.isEmpty()) {
+    idleDelay = USB_TIMER_WHEEL_TICK_MS;
+  }
+  if (typing.isActive()) {
+    uint32_t untilFrame = typing.getTimeUntilNextFrame(millis());
+    idleDelay = untilFrame < 1 ? 1 : (untilFrame < idleDelay ? untilFrame : idleDelay);
+  }
+  if (!playoutPending) {
+    return idleDelay;
+  }
+
+  // Wake up right when the held event is due instead of on the next fixed tick
+  int32_t untilPlayout = (int32_t)(nextPlayoutTime - millis());
+  if (untilPlayout < 1) {
+    return 1;
+  }
+  return (uint32_t)untilPlayout < idleDelay ? untilPlayout : idleDelay;
+}
+
+bool USBManager::isFrameDue(uint32_t& nextFrameTime, HIDReportDevice device, uint32_t now) {
+  // Caller holds hidMutex. A late frame is sent now and the stream carries on from here, frames in between are lost.
+  int32_t late = (int32_t)(now - nextFrameTime);
+  if (late < 0) {
+    return false;
+  }
+
+  uint8_t interval = reportIntervalMs[device];
+  rateMeter.recordMissed(device, late / interval);
+  nextFrameTime = now + interval;
+  return true;
+}
+
+bool USBManager::setReportInterval(HIDReportDevice device, uint16_t intervalMs) {
+  // The pointer only sends what the client sends, there is nothing to pace
+  if (device >= HID_REPORT_POINTER || intervalMs < 1 || intervalMs > USB_REPORT_MAX_INTERVAL_MS) {
+    return false;
+  }
+
+  if (!hidMutex || !xSemaphoreTake(hidMutex, pdMS_TO_TICKS(100))) {
+    DEBUG_PRINTLN("ERROR: Failed to acquire HID mutex for report interval");
+    return false;
+  }
+
+  reportIntervalMs[device] = intervalMs;
+  if (device == HID_REPORT_KEYBOARD) {
+    typing.setMinFrameInterval(intervalMs);
+  }
+  xSemaphoreGive(hidMutex);
+
+  DEBUG_PRINTF("%s report interval set to %u ms\n", HIDRateMeter::getDeviceName(device), intervalMs);
+  return true;
+}
+
+bool USBManager::setRateMeasurement(bool enabled) {
+  if (!hidMutex || !xSemaphoreTake(hidMutex, pdMS_TO_TICKS(100))) {
+    DEBUG_PRINTLN("ERROR: Failed to acquire HID mutex for rate measurement");
+    return false;
+  }
+
+  // Starting again resets the counters
+  if (enabled) {
+    rateMeter.start(millis());
+  }
+  else {
+    rateMeter.stop();
+  }
+  xSemaphoreGive(hidMutex);
+
+  DEBUG_PRINTF("HID rate measurement %s\n", enabled ? "started" : "stopped");
+  return true;
+}
+
+const char* USBManager::getRateInfo() {
+  static char info[256];
+
+  HIDRateStats stats[HID_REPORT_DEVICE_COUNT] = {};
+  uint8_t intervals[HID_REPORT_DEVICE_COUNT] = {};
+  uint32_t elapsed = 0;
+  bool enabled = false;
+  if (hidMutex && xSemaphoreTake(hidMutex, pdMS_TO_TICKS(10))) {
+    enabled = rateMeter.isEnabled();
+    elapsed = rateMeter.getElapsed(millis());
+    for (uint8_t i = 0; i < HID_REPORT_DEVICE_COUNT; i++) {
+      stats[i] = rateMeter.getStats((HIDReportDevice)i);
+      intervals[i] = reportIntervalMs[i];
+    }
+    xSemaphoreGive(hidMutex);
+  }
+
+  int length = snprintf(info, sizeof(info), "HID_RATE_INFO:%u|%lu", enabled ? 1 : 0, (unsigned long)elapsed);
+  for (uint8_t i = 0; i < HID_REPORT_DEVICE_COUNT && length > 0 && (size_t)length < sizeof(info); i++) {
+    float rate = elapsed > 0 ? stats[i].reports * 1000.0f / elapsed : 0.0f;
+    length += snprintf(info + length, sizeof(info) - length, "|%s|%u|%lu|%.1f|%lu|%lu",
+      HIDRateMeter::getDeviceName((HIDReportDevice)i),
+      intervals[i],
+      (unsigned long)stats[i].reports,
+      rate,
+      (unsigned long)stats[i].failed,
+      (unsigned long)stats[i].missed);
+  }
+
+  return info;
+}
+
+HIDQueueResult USBManager::queueHIDMessages(const HIDMessage* messages, size_t count) {
+  if (!isUSBHIDEnabled()) return HID_QUEUE_OK;
+
+  if (!messages || count == 0 || !initialized || !hidQueue || !queueMutex) return HID_QUEUE_INVALID;
+
+  for (size_t i = 0; i < count; i++) {
+    if (!isValidHIDMessage(messages[i])) {
+      DEBUG_PRINTF("ERROR: Invalid HID message %d of %d (command %d)\n", i + 1, count, messages[i].command);
+      return HID_QUEUE_INVALID;
+    }
+  }
+
+  if (!xSemaphoreTake(queueMutex, pdMS_TO_TICKS(10))) {
+    DEBUG_PRINTLN("ERROR: Failed to acquire HID queue mutex");
+    return HID_QUEUE_BUSY;
+  }
+
+  size_t textLength = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (messages[i].command == HID_KEYBOARD_TYPE) {
+      textLength += messages[i].textLength;
+    }
+  }
+
+  // All or nothing, the USB task then drains the messages back to back in consecutive reports
+  if (uxQueueSpacesAvailable(hidQueue) < count || textPool.available() < textLength) {
+    xSemaphoreGive(queueMutex);
+    return HID_QUEUE_BUSY;
+  }
+
+  bool queued = true;
+  for (size_t i = 0; queued && i < count; i++) {
+    HIDMessage message = messages[i];
+    if (message.command == HID_KEYBOARD_TYPE) {
+      const char* text = message.text;
+      queued = textPool.allocate(text, message.textLength, message.textOffset);
+    }
+    queued = queued && xQueueSend(hidQueue, &message, 0) == pdTRUE;
+  }
+
+  xSemaphoreGive(queueMutex);
+  return queued ? HID_QUEUE_OK : HID_QUEUE_BUSY;
 }
 
 bool USBManager::sendKeyPress(uint8_t key) {
@@ -438,10 +1287,9 @@ bool USBManager::sendKeyPress(uint8_t key) {
   message.x = 0;
   message.y = 0;
   message.buttons = 0;
-  message.text[0] = '\0';
   message.timestamp = millis();
 
-  return xQueueSend(hidQueue, &message, 0) == pdTRUE;
+  return queueHIDMessages(&message, 1) == HID_QUEUE_OK;
 }
 
 bool USBManager::sendKeyHold(uint8_t key) {
@@ -455,10 +1303,9 @@ bool USBManager::sendKeyHold(uint8_t key) {
   message.x = 0;
   message.y = 0;
   message.buttons = 0;
-  message.text[0] = '\0';
   message.timestamp = millis();
 
-  return xQueueSend(hidQueue, &message, 0) == pdTRUE;
+  return queueHIDMessages(&message, 1) == HID_QUEUE_OK;
 }
 
 bool USBManager::sendKeyRelease(uint8_t key) {
@@ -472,29 +1319,9 @@ bool USBManager::sendKeyRelease(uint8_t key) {
   message.x = 0;
   message.y = 0;
   message.buttons = 0;
-  message.text[0] = '\0';
   message.timestamp = millis();
 
-  return xQueueSend(hidQueue, &message, 0) == pdTRUE;
-}
-
-bool USBManager::typeText(const char* text) {
-  if (!isUSBHIDEnabled()) return true;
-
-  if (!text || strlen(text) == 0 || !initialized || !hidQueue) return false;
-
-  HIDMessage message = {};
-  message.command = HID_KEYBOARD_TYPE;
-  message.key = 0;
-  message.x = 0;
-  message.y = 0;
-  message.buttons = 0;
-  message.timestamp = millis();
-
-  strncpy(message.text, text, sizeof(message.text) - 1);
-  message.text[sizeof(message.text) - 1] = '\0';
-
-  return xQueueSend(hidQueue, &message, 0) == pdTRUE;
+  return queueHIDMessages(&message, 1) == HID_QUEUE_OK;
 }
 
 bool USBManager::sendMouseMove(int16_t x, int16_t y) {
@@ -508,10 +1335,9 @@ bool USBManager::sendMouseMove(int16_t x, int16_t y) {
   message.x = x;
   message.y = y;
   message.buttons = 0;
-  message.text[0] = '\0';
   message.timestamp = millis();
 
-  return xQueueSend(hidQueue, &message, 0) == pdTRUE;
+  return queueHIDMessages(&message, 1) == HID_QUEUE_OK;
 }
 
 bool USBManager::sendMousePress(uint8_t button) {
@@ -525,10 +1351,9 @@ bool USBManager::sendMousePress(uint8_t button) {
   message.x = 0;
   message.y = 0;
   message.buttons = button;
-  message.text[0] = '\0';
   message.timestamp = millis();
 
-  return xQueueSend(hidQueue, &message, 0) == pdTRUE;
+  return queueHIDMessages(&message, 1) == HID_QUEUE_OK;
 }
 
 bool USBManager::sendMouseHold(uint8_t button) {
@@ -542,10 +1367,9 @@ bool USBManager::sendMouseHold(uint8_t button) {
   message.x = 0;
   message.y = 0;
   message.buttons = button;
-  message.text[0] = '\0';
   message.timestamp = millis();
 
-  return xQueueSend(hidQueue, &message, 0) == pdTRUE;
+  return queueHIDMessages(&message, 1) == HID_QUEUE_OK;
 }
 
 bool USBManager::sendMouseRelease(uint8_t button) {
@@ -559,10 +1383,9 @@ bool USBManager::sendMouseRelease(uint8_t button) {
   message.x = 0;
   message.y = 0;
   message.buttons = button;
-  message.text[0] = '\0';
   message.timestamp = millis();
 
-  return xQueueSend(hidQueue, &message, 0) == pdTRUE;
+  return queueHIDMessages(&message, 1) == HID_QUEUE_OK;
 }
 
 bool USBManager::sendMouseScroll(int16_t x, int16_t y) {
@@ -576,10 +1399,9 @@ bool USBManager::sendMouseScroll(int16_t x, int16_t y) {
   message.x = x;
   message.y = y;
   message.buttons = 0;
-  message.text[0] = '\0';
   message.timestamp = millis();
 
-  return xQueueSend(hidQueue, &message, 0) == pdTRUE;
+  return queueHIDMessages(&message, 1) == HID_QUEUE_OK;
 }
 
 bool USBManager::sendGamepadButton(uint8_t button, bool pressed) {
@@ -593,10 +1415,9 @@ bool USBManager::sendGamepadButton(uint8_t button, bool pressed) {
   message.x = 0;
   message.y = 0;
   message.buttons = static_cast<uint8_t>(pressed ? 0x80 : 0x00);
-  message.text[0] = '\0';
   message.timestamp = millis();
 
-  return xQueueSend(hidQueue, &message, 0) == pdTRUE;
+  return queueHIDMessages(&message, 1) == HID_QUEUE_OK;
 }
 
 bool USBManager::sendGamepadRightAxis(int16_t x, int16_t y) {
@@ -610,10 +1431,9 @@ bool USBManager::sendGamepadRightAxis(int16_t x, int16_t y) {
   message.x = x;
   message.y = y;
   message.buttons = 0;
-  message.text[0] = '\0';
   message.timestamp = millis();
 
-  return xQueueSend(hidQueue, &message, 0) == pdTRUE;
+  return queueHIDMessages(&message, 1) == HID_QUEUE_OK;
 }
 
 bool USBManager::sendGamepadLeftAxis(int16_t x, int16_t y) {
@@ -627,10 +1447,9 @@ bool USBManager::sendGamepadLeftAxis(int16_t x, int16_t y) {
   message.x = x;
   message.y = y;
   message.buttons = 0;
-  message.text[0] = '\0';
   message.timestamp = millis();
 
-  return xQueueSend(hidQueue, &message, 0) == pdTRUE;
+  return queueHIDMessages(&message, 1) == HID_QUEUE_OK;
 }
 
 bool USBManager::sendSystemPowerKey() {
@@ -646,10 +1465,27 @@ bool USBManager::sendSystemPowerKey() {
   message.x = 0;
   message.y = 0;
   message.buttons = 0;
-  message.text[0] = '\0';
   message.timestamp = millis();
 
-  return xQueueSend(hidQueue, &message, 0) == pdTRUE;
+  return queueHIDMessages(&message, 1) == HID_QUEUE_OK;
+}
+
+bool USBManager::setPointerSurface(uint16_t width, uint16_t height) {
+  if (width < 2 || height < 2 || width > USB_POINTER_MAX_SURFACE || height > USB_POINTER_MAX_SURFACE) {
+    return false;
+  }
+
+  if (!hidMutex || !xSemaphoreTake(hidMutex, pdMS_TO_TICKS(100))) {
+    DEBUG_PRINTLN("ERROR: Failed to acquire HID mutex for pointer surface");
+    return false;
+  }
+
+  pointerSurfaceWidth = width;
+  pointerSurfaceHeight = height;
+  xSemaphoreGive(hidMutex);
+
+  DEBUG_PRINTF("Pointer surface set to %ux%u\n", width, height);
+  return true;
 }
 
 void USBManager::handleVendorReport(uint8_t report_id, const uint8_t* buffer, uint16_t len) {
@@ -750,46 +1586,16 @@ InfoPayload USBManager::buildInfoPayload() {
 bool USBManager::isValidKey(uint8_t key) {
   if (!isUSBHIDEnabled()) return true;
 
-  if (key >= 32 && key <= 126) {
+  // Arduino key codes: modifiers and non-printing keys from 0x80 up, below that US ASCII
+  if (key >= 0x80) {
     return true;
   }
 
-  switch (key) {
-  case 0x08: // Backspace
-  case 0x09: // Tab
-  case 0x0A: // Enter (Line Feed)
-  case 0x0D: // Enter (Carriage Return)
-  case 0x1B: // Escape
-  case 0x20: // Space
-  case 0x7F: // Delete
-    return true;
-
-  case 194: // F1 (0xC2)
-  case 195: // F2 (0xC3)
-  case 196: // F3 (0xC4)
-  case 197: // F4 (0xC5)
-  case 198: // F5
-  case 199: // F6
-  case 200: // F7
-  case 201: // F8
-  case 202: // F9
-  case 203: // F10
-  case 204: // F11
-  case 205: // F12
-    return true;
-
-    // Arrow keys
-  case 215: // Left Arrow
-  case 216: // Up Arrow
-  case 217: // Right Arrow
-  case 218: // Down Arrow
-    return true;
-
-  default:
-    break;
+  HIDKeyStroke stroke;
+  if (!lookupKeyStroke(HID_LAYOUT_US, key, stroke)) {
+    DEBUG_PRINTF("Key validation: Key code %d has no key\n", key);
+    return false;
   }
-
-  DEBUG_PRINTF("Key validation: Key code %d may not be valid\n", key);
   return true;
 }
 
@@ -798,6 +1604,37 @@ bool USBManager::isValidMouseButton(uint8_t button) {
   return button > 0 && button <= 7;
 }
 
+bool USBManager::isValidHIDMessage(const HIDMessage& message) {
+  switch (message.command) {
+  case HID_KEYBOARD_PRESS:
+  case HID_KEYBOARD_HOLD:
+  case HID_KEYBOARD_RELEASE:
+    return isValidKey(message.key);
+  case HID_KEYBOARD_TYPE:
+    return message.text && message.textLength > 0 && message.textLength <= USB_HID_TEXT_POOL_SIZE;
+  case HID_MOUSE_PRESS:
+  case HID_MOUSE_HOLD:
+  case HID_MOUSE_RELEASE:
+    return isValidMouseButton(message.buttons);
+  case HID_GAMEPAD_PRESS:
+  case HID_GAMEPAD_HOLD:
+  case HID_GAMEPAD_RELEASE:
+  case HID_GAMEPAD_BUTTON:
+    return message.key > 0 && message.key <= USB_GAMEPAD_BUTTON_COUNT;
+  case HID_MOUSE_VELOCITY:
+    return message.duration <= USB_MOTION_MAX_DURATION_MS;
+  case HID_GAMEPAD_AXIS_TARGET:
+    return message.key <= HID_STICK_RIGHT && message.duration <= USB_MOTION_MAX_DURATION_MS;
+  case HID_GAMEPAD_REPORT: {
+    HIDGamepadReport report;
+    memcpy(&report, message.report, sizeof(report));
+    return report.hat <= HAT_UP_LEFT;
+  }
+  default:
+    return true;
+  }
+}
+
 void USBManager::checkInitialUSBStatus() {
   if (!isUSBHIDEnabled()) {
     DEBUG_PRINTLN("USBManager: Initial USB status check skipped (USB disabled)");
@@ -0,0 +1,11 @@
+// tests/host/config/Config.h
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// Host stand-in for include/config/Config.h, which pulls in Arduino and FreeRTOS. Only what the
+// host-buildable classes need, with the firmware values; the tests are written against the macros.
+#define USB_TIMER_WHEEL_TICK_MS             5
+#define USB_TIMER_WHEEL_SLOTS               64
+#define USB_TIMER_WHEEL_CAPACITY            32
+
+#endif // CONFIG_H
@@ -0,0 +1,136 @@
+// tests/timer_wheel_test.cpp
+#include <classes/HIDTimerWheel.h>
+#include <cstdio>
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+  if (!(cond)) { \
+    failures++; \
+    printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+    printf(__VA_ARGS__); \
+    printf("\n"); \
+  } \
+} while(0)
+
+// Polls the wheel every millisecond from `from`, returns the milliseconds until a timer came out or NEVER
+static const uint32_t NEVER = 0xFFFFFFFF;
+
+static uint32_t runUntilExpired(HIDTimerWheel& wheel, uint32_t from, uint32_t limit, HIDTimer& timer) {
+  for (uint32_t elapsed = 0; elapsed <= limit; elapsed++) {
+    if (wheel.popExpired(from + elapsed, timer)) {
+      return elapsed;
+    }
+  }
+  return NEVER;
+}
+
+// A timer scheduled at any phase of the tick clock fires no earlier than its delay and less than a tick late
+static void testExpiryBounds() {
+  const uint32_t delays[] = { 0, 1, 4, 5, 6, 99, 100, 319, 320, 321, 641, 1000, 5000 };
+
+  for (uint32_t delay : delays) {
+    for (uint32_t phase = 0; phase < USB_TIMER_WHEEL_TICK_MS; phase++) {
+      HIDTimerWheel wheel;
+      HIDTimer timer;
+
+      // A long timer keeps the wheel busy so the clock is not restarted when the one under test is scheduled
+      uint32_t start = 1000;
+      wheel.schedule({ HID_TIMER_GAMEPAD_RELEASE, 1 }, 60000, start);
+      uint32_t now = start + 3 * USB_TIMER_WHEEL_TICK_MS + phase;
+      CHECK(wheel.schedule({ HID_TIMER_KEY_RELEASE, 4 }, delay, now), "schedule failed");
+
+      uint32_t elapsed = runUntilExpired(wheel, now, delay + 2 * USB_TIMER_WHEEL_TICK_MS, timer);
+      uint32_t latest = (delay == 0 ? 1 : delay) + USB_TIMER_WHEEL_TICK_MS - 1;
+      CHECK(elapsed != NEVER, "delay %u phase %u never expired", delay, phase);
+      CHECK(elapsed >= delay, "delay %u phase %u fired early after %u ms", delay, phase, elapsed);
+      CHECK(elapsed <= latest, "delay %u phase %u fired late after %u ms", delay, phase, elapsed);
+      CHECK(timer.action == HID_TIMER_KEY_RELEASE && timer.code == 4, "delay %u phase %u wrong timer", delay, phase);
+    }
+  }
+}
+
+// Delays that land on the same slot a whole number of revolutions apart wait out their rounds
+static void testRounds() {
+  HIDTimerWheel wheel;
+  HIDTimer timer;
+  const uint32_t revolution = USB_TIMER_WHEEL_SLOTS * USB_TIMER_WHEEL_TICK_MS;
+
+  wheel.schedule({ HID_TIMER_KEY_RELEASE, 1 }, 3 * revolution, 0);
+  wheel.schedule({ HID_TIMER_KEY_RELEASE, 2 }, revolution, 0);
+  wheel.schedule({ HID_TIMER_KEY_RELEASE, 3 }, 2 * revolution, 0);
+
+  const uint8_t order[] = { 2, 3, 1 };
+  uint32_t now = 0;
+  for (uint8_t i = 0; i < 3; i++) {
+    uint32_t expired = now + runUntilExpired(wheel, now, 4 * revolution, timer);
+    uint32_t expected = (order[i] == 1 ? 3 : order[i] - 1) * revolution;
+    CHECK(timer.code == order[i], "expected key %u, got %u", order[i], timer.code);
+    CHECK(expired == expected, "key %u expired at %u instead of %u", timer.code, expired, expected);
+    now = expired + 1;
+  }
+  CHECK(wheel.isEmpty(), "wheel not empty after all rounds");
+}
+
+// Timers sharing a slot come out in the order they were scheduled
+static void testScheduleOrder() {
+  HIDTimerWheel wheel;
+  HIDTimer timer;
+
+  for (uint8_t code = 1; code <= 5; code++) {
+    wheel.schedule({ HID_TIMER_KEY_RELEASE, code }, 50, 0);
+  }
+  uint32_t now = 0;
+  for (uint8_t code = 1; code <= 5; code++) {
+    now += runUntilExpired(wheel, now, 100, timer);
+    CHECK(now == 50, "key %u at %u ms instead of 50", code, now);
+    CHECK(timer.code == code, "expected key %u, got %u", code, timer.code);
+  }
+}
+
+// The wheel refuses timers past its capacity and frees entries on cancel and expiry
+static void testCapacityAndCancel() {
+  HIDTimerWheel wheel;
+  HIDTimer timer;
+
+  for (uint8_t i = 0; i < USB_TIMER_WHEEL_CAPACITY; i++) {
+    CHECK(wheel.schedule({ HID_TIMER_KEY_RELEASE, (uint8_t)(i + 1) }, 10 + i, 0), "schedule %u failed", i);
+  }
+  CHECK(wheel.getFreeCount() == 0, "free count %u on a full wheel", wheel.getFreeCount());
+  CHECK(!wheel.schedule({ HID_TIMER_MOUSE_RELEASE, 1 }, 10, 0), "schedule past capacity succeeded");
+
+  CHECK(wheel.cancel(HID_TIMER_KEY_RELEASE, 1), "cancel failed");
+  CHECK(!wheel.cancel(HID_TIMER_KEY_RELEASE, 1), "second cancel succeeded");
+  CHECK(wheel.getFreeCount() == 1, "free count %u after cancel", wheel.getFreeCount());
+  CHECK(wheel.schedule({ HID_TIMER_MOUSE_RELEASE, 1 }, 10, 0), "schedule after cancel failed");
+
+  CHECK(wheel.cancelAll(HID_TIMER_KEY_RELEASE) == USB_TIMER_WHEEL_CAPACITY - 1, "cancelAll count");
+  CHECK(runUntilExpired(wheel, 0, 100, timer) != NEVER && timer.action == HID_TIMER_MOUSE_RELEASE, "mouse timer lost");
+  CHECK(wheel.isEmpty(), "wheel not empty");
+}
+
+// The tick clock wraps with millis()
+static void testMillisWrap() {
+  HIDTimerWheel wheel;
+  HIDTimer timer;
+  uint32_t now = 0xFFFFFFFF - 20;
+
+  wheel.schedule({ HID_TIMER_KEY_RELEASE, 7 }, 50, now);
+  uint32_t elapsed = runUntilExpired(wheel, now, 100, timer);
+  CHECK(elapsed >= 50 && elapsed < 50 + USB_TIMER_WHEEL_TICK_MS, "fired after %u ms across the wrap", elapsed);
+}
+
+int main() {
+  testExpiryBounds();
+  testRounds();
+  testScheduleOrder();
+  testCapacityAndCancel();
+  testMillisWrap();
+
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("All timer wheel tests passed\n");
+  return 0;
+}